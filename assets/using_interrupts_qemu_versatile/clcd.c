@@ -20,6 +20,8 @@ enum {
 	LPBASE = 0x5,
 	CTRL = 0x6,
 	IMSC = 0x7,
+	RIS = 0x8,
+	MIS = 0x9,
 	ICR = 0xa,
 	SYS = 0x14,
 	PAL = 0x80,
@@ -40,6 +42,14 @@ enum {
 	CR_PWR = 0x800,
 };
 
+// interrupt bits
+enum {
+	FUF = 0x2,
+	LNBU = 0x4,
+	VCOMP = 0x8,
+	MBERROR = 0x10,
+};
+
 // color depth
 enum {
 	BPP1 = 0,
@@ -52,15 +62,67 @@ enum {
 	BPP12,
 };
 
+enum {
+	// how many 100 microsecond intervals
+	// to wait for a page flip (20 ms)
+	FLIPWAIT = 200,
+
+	// microseconds in a frame at 60 Hz, for
+	// when the controller doesn't tell us
+	FRAMEUS = 1000000 / 60,
+};
+
 Clcd physclcd[] = {
     {
         .r = (void *)CLCD,
         .w = 640,
         .h = 480,
-        .fb = (void *)0x150000,
+        .depth = 16,
+        .page = {
+            (void *)0x150000,
+            (void *)0x27c000,
+        },
     },
 };
 
+// returns the palette entry for a 3-3-2 color index, the
+// entries are 5 bits each of red, green and blue. red goes in
+// the top field, the same one 16 bit pixels keep red in, so
+// the controller shows both depths with the same colors
+static u32
+palentry(int i)
+{
+	u32 r, g, b;
+
+	r = (i >> 5) & 0x7;
+	g = (i >> 2) & 0x7;
+	b = i & 0x3;
+	r = (r << 2) | (r >> 1);
+	g = (g << 2) | (g >> 1);
+	b = (b << 3) | (b << 1) | (b >> 1);
+	return b | (g << 5) | (r << 10);
+}
+
+// returns the color depth setting for the
+// control register, 8 bit color needs the
+// palette to be loaded
+static int
+format(Clcd *c)
+{
+	int i;
+
+	switch (c->depth) {
+	case 8:
+		// each palette register holds two entries
+		for (i = 0; i < 256; i += 2)
+			c->r[PAL + i / 2] = palentry(i) | (palentry(i + 1) << 16);
+		return BPP8;
+	case 16:
+		return BPP16_565;
+	}
+	return BPP32;
+}
+
 // resets the CLCD controller
 static void
 reset(Clcd *c)
@@ -71,12 +133,23 @@ reset(Clcd *c)
 	// setup width/height
 	c->r[TIM0] = c->w / 4 - 4;
 	c->r[TIM1] = c->h - 1;
+	c->stride = c->w * (c->depth / 8);
 
-	// frame buffer location
-	c->r[UPBASE] = (uintptr)c->fb;
+	// draw to the whole screen
+	c->clipr = (Rect){0, 0, c->w, c->h};
+
+	// show the first page and draw to the second
+	c->back = 1;
+	c->fb = c->page[c->back];
+	c->r[UPBASE] = (uintptr)c->page[0];
+
+	// pixel format, the vertical compare
+	// interrupt fires at the start of vertical sync
+	c->r[CTRL] = format(c) << 1;
 
-	// 32 bit color (rgba)
-	c->r[CTRL] = (BPP32 << 1);
+	// interrupt us on page flips and every frame
+	c->r[ICR] = LNBU | VCOMP;
+	c->r[IMSC] = LNBU | VCOMP;
 }
 
 // disable the screen, it leaves whatever was on
@@ -95,12 +168,99 @@ clcdenable(Clcd *c)
 	c->r[CTRL] |= (CR_PWR | CR_EN);
 }
 
+// show the page we have been drawing to and make the
+// page that was on the screen the new drawing target
+void
+clcdflip(Clcd *c)
+{
+	int i;
+
+	// clcdintr clears flipping when the controller takes
+	// the new base, so set it before handing the base over
+	c->flipping = true;
+	coherence();
+	c->r[UPBASE] = (uintptr)c->fb;
+	c->back ^= 1;
+	c->fb = c->page[c->back];
+
+	// the controller only latches the new base address
+	// at the start of the next frame, the interrupt handler
+	// tells us when that happened so we don't draw to the
+	// page that is still being shown. give up after a frame's
+	// worth of time, and if the device never reported the
+	// update don't wait for it again
+	if (c->nolnbu) {
+		c->flipping = false;
+		return;
+	}
+	for (i = 0; i < FLIPWAIT && c->flipping; i++)
+		microdelay(100);
+	if (c->flipping)
+		c->nolnbu = true;
+	c->flipping = false;
+}
+
+// wait for the start of the next vertical blank
+void
+clcdvsync(Clcd *c)
+{
+	ulong n;
+	u32 t;
+	int i;
+
+	// the controller never raised the vertical compare
+	// interrupt, wait out the rest of a frame instead
+	if (c->novcomp) {
+		t = usec() - c->lastvsync;
+		if (t < FRAMEUS)
+			microdelay(FRAMEUS - t);
+		c->lastvsync = usec();
+		return;
+	}
+
+	n = c->frames;
+	for (i = 0; i < FLIPWAIT && c->frames == n; i++)
+		microdelay(100);
+	if (c->frames == n) {
+		c->novcomp = true;
+		c->lastvsync = usec();
+	}
+}
+
 // initializes the CLCD display controller
 void
 clcdinit(void)
 {
-	reset(&physclcd[0]);
-	screen = &physclcd[0];
-	fillrect(0, 0, screen->w, screen->h, 0xff555555);
-	microdelay(5);
+	Clcd *c;
+	int i;
+
+	c = &physclcd[0];
+	reset(c);
+	screen = c;
+
+	// clear both pages
+	for (i = 0; i < nelem(c->page); i++) {
+		c->fb = c->page[i];
+		fillrect(0, 0, c->w, c->h, 0xff555555);
+	}
+	c->fb = c->page[c->back];
+
+	clcdenable(c);
+}
+
+// handle base address update and vertical compare interrupts
+void
+clcdintr(Ureg *, void *a)
+{
+	Clcd *c;
+	u32 s;
+
+	c = a;
+	s = c->r[MIS];
+	c->r[ICR] = s;
+
+	if (s & LNBU)
+		c->flipping = false;
+	if (s & VCOMP)
+		c->frames++;
 }
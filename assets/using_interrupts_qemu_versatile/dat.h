@@ -4,47 +4,283 @@
 typedef struct Uart Uart;
 typedef struct Clcd Clcd;
 typedef struct Timer Timer;
+typedef struct Alarm Alarm;
+typedef struct Dma Dma;
 typedef struct Input Input;
+typedef struct Event Event;
 typedef struct Cursor Cursor;
 typedef struct Rect Rect;
+typedef struct Damage Damage;
+typedef struct Console Console;
 typedef struct Vctl Vctl;
+typedef struct Work Work;
+typedef struct Intrstat Intrstat;
+typedef struct Syscall Syscall;
 typedef struct Ureg Ureg;
 
+enum {
+	// max # of dirty rectangles tracked per page
+	NDAMAGE = 16,
+
+	// max width and height of the cursor
+	CURSORMAX = 32,
+
+	// size of a glyph in the font
+	FONTW = 8,
+	FONTH = 8,
+
+	// # of bytes a fill or copy needs to be
+	// before it is handed to the DMA engine
+	DMAMIN = 4096,
+
+	// size of the input byte rings, a power of 2
+	NINBUF = 256,
+
+	// # of work items that can be queued, a power of 2
+	NWORK = 64,
+
+	// # of buckets in the interrupt latency histogram,
+	// bucket 0 counts latencies of 0 us and bucket i
+	// the ones from 2^(i-1) up to 2^i us
+	NLATHIST = 8,
+
+	// max # of pending alarms
+	NALARM = 256,
+
+	// size of the uart output ring, a power of 2
+	NUARTBUF = 4096,
+};
+
+// output waits in buf between rp and wp
+// for the interrupt to move it to the fifo
 struct Uart {
 	volatile u32 *r;
+	bool intr;
+	uchar buf[NUARTBUF];
+	ulong rp, wp;
+};
+
+// interrupt priorities for intrenable, lower numbers
+// get to interrupt higher ones, lines with the
+// same number don't interrupt each other
+enum {
+	PRIOHI = 0,
+	PRIOLO = 15,
+};
+
+struct Rect {
+	int x, y, w, h;
+};
+
+struct Damage {
+	Rect r[NDAMAGE];
+	int n;
 };
 
 struct Clcd {
 	volatile u32 *r;
 
 	int w, h;
-	u32 *fb;
+
+	// bits per pixel (8, 16 or 32) and
+	// the number of bytes in a row
+	int depth;
+	int stride;
+
+	// fb is the page we are drawing to,
+	// the other page is being shown
+	uchar *fb;
+	uchar *page[2];
+	int back;
+
+	// drawing is clipped to clipr, dirty
+	// holds what each page needs redrawn
+	Rect clipr;
+	Damage dirty[2];
+
+	// set once a flip went unreported, some
+	// controllers (QEMU's) never report them
+	bool nolnbu;
+
+	// set once a vertical compare never came, vsyncs
+	// are then timed by the clock from lastvsync
+	bool novcomp;
+	u32 lastvsync;
+
+	// updated by the interrupt handler
+	volatile ulong frames;
+	volatile bool flipping;
+};
+
+struct Console {
+	// where on the screen the console is
+	Rect r;
+
+	// size in characters and the cursor position
+	int cols, rows;
+	int x, y;
+
+	// pixels for every nibble of glyph bits and
+	// the background replicated across a word
+	u32 expand[16][4];
+	u32 bg;
+
+	// pixels of the console in the screen depth
+	uchar *p;
+	int stride;
 };
 
 struct Timer {
 	volatile u32 *r;
 };
 
+// a callback at a point in time, when is in usec()
+// and index is where it sits in the pending alarms
+struct Alarm {
+	void (*f)(Alarm *);
+	void *a;
+	u32 when;
+	int index;
+};
+
+struct Dma {
+	volatile u32 *r;
+
+	// word used as the source of fills
+	u32 fill;
+
+	// set while a transfer is in flight
+	volatile bool busy;
+};
+
+// input event types
+enum {
+	EVKEY = 1,
+	EVMOUSE,
+};
+
+// key codes, the keys that print are their
+// ascii character without shift, the rest are
+// above 0x7f. all fit in 8 bits
+enum {
+	KBS = '\b',
+	KTAB = '\t',
+	KENTER = '\n',
+	KESC = 0x1b,
+
+	KF1 = 0x80,
+	KF2,
+	KF3,
+	KF4,
+	KF5,
+	KF6,
+	KF7,
+	KF8,
+	KF9,
+	KF10,
+	KF11,
+	KF12,
+
+	KUP = 0x90,
+	KDOWN,
+	KLEFT,
+	KRIGHT,
+	KHOME,
+	KEND,
+	KPGUP,
+	KPGDN,
+	KINS,
+	KDEL,
+
+	KLSHIFT = 0xa0,
+	KRSHIFT,
+	KLCTL,
+	KRCTL,
+	KLALT,
+	KRALT,
+	KCAPS,
+};
+
+// a decoded input event
+struct Event {
+	int type;
+
+	// EVKEY, the key code and if it went down or up
+	int key;
+	bool down;
+
+	// EVMOUSE, the movement with y going
+	// down the screen and the buttons held
+	int dx, dy;
+	int buttons;
+};
+
+// bytes read from the device go into buf at wp
+// and get taken out at rp, wp only moves in the fiq
+// and rp only outside of it so neither needs a lock.
+// _vfiq knows the layout of the fields up to buf
 struct Input {
 	volatile u32 *r;
+	volatile ulong rp, wp;
+	ulong overrun;
+	uchar buf[NINBUF];
 	bool ismouse;
+
+	// decoding state, keyboard prefixes seen, bytes left
+	// to skip and the mouse packet read so far
+	int prefix;
+	int skip;
+	uchar pkt[3];
+	int npkt;
+
+	// # of bytes skipped to get back in sync
+	ulong resync;
+
+	// decoded mouse event that did not fit
+	Event pend;
+	bool haspend;
 };
 
 struct Cursor {
 	int x, y;
 	int dx, dy;
 	int w, h;
+	u32 color;
 };
 
-struct Rect {
-	int x, y, w, h;
+// work deferred out of an interrupt handler
+struct Work {
+	void (*f)(void *);
+	void *a;
+	volatile bool queued;
+};
+
+// interrupt timing, in microseconds
+struct Intrstat {
+	ulong count;
+	ulong total;
+	ulong min, max;
+	ulong lat[NLATHIST];
 };
 
 struct Vctl {
 	int irq;
+	int prio;
 	void (*f)(Ureg *, void *);
 	void *a;
 	char *name;
+	Intrstat stat;
+
+	// the other lines with the same priority
+	u32 same;
+};
+
+// a system call, fast ones take R0-R3 as arguments and
+// the rest take the ureg. only one of the two is set,
+// _vsvc knows the layout
+struct Syscall {
+	ulong (*fast)(ulong, ulong, ulong, ulong);
+	ulong (*f)(Ureg *);
 };
 
 struct Ureg {
@@ -79,4 +315,8 @@ struct Ureg {
 
 extern Uart *consuart;
 extern Clcd *screen;
-extern int scheduled;
\ No newline at end of file
+extern Dma *dma;
+extern Input *kbd;
+extern Input *mouse;
+extern ulong ticks;
+extern ulong idleus;
\ No newline at end of file
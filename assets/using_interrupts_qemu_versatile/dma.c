@@ -0,0 +1,185 @@
+#include "u.h"
+#include "libc.h"
+#include "dat.h"
+#include "fns.h"
+
+// base physical address
+// of the PL080 DMA controller
+enum {
+	DMA = 0x10130000,
+};
+
+// the registers offset
+// each is 32 bit wide
+enum {
+	INTSTAT = 0x0,
+	INTTCSTAT = 0x1,
+	INTTCCLR = 0x2,
+	INTERRSTAT = 0x3,
+	INTERRCLR = 0x4,
+	ENBLDCHNS = 0x7,
+	CONFIG = 0xc,
+
+	// channel 0 registers, the other
+	// channels follow every 8 registers
+	C0SRC = 0x40,
+	C0DST = 0x41,
+	C0LLI = 0x42,
+	C0CTL = 0x43,
+	C0CFG = 0x44,
+};
+
+// controller config register bits
+enum {
+	DMACEN = 0x1,
+};
+
+// channel control register bits
+enum {
+	// # of transfers, in units of the source width
+	COUNTMAX = 0xfff,
+
+	// burst size of 4 transfers for source/destination
+	SBSIZE4 = 1 << 12,
+	DBSIZE4 = 1 << 15,
+
+	// 32 bit wide transfers for source/destination
+	SWORD = 2 << 18,
+	DWORD = 2 << 21,
+
+	// increment source/destination after each transfer
+	SI = 1 << 26,
+	DI = 1 << 27,
+
+	// interrupt when the transfer is done
+	TCINT = 1 << 31,
+};
+
+// channel config register bits
+enum {
+	CE = 0x1,
+	IE = 1 << 14,
+	ITC = 1 << 15,
+};
+
+enum {
+	// max # of linked list items, one per row
+	NLLI = 512,
+};
+
+// linked list item, describes the transfer to
+// do after the one in the channel registers is done
+typedef struct Lli {
+	u32 src;
+	u32 dst;
+	u32 next;
+	u32 ctl;
+} Lli;
+
+static Lli lli[NLLI];
+
+Dma physdma[] = {
+    {
+        .r = (void *)DMA,
+    },
+};
+
+// initializes the DMA controller
+void
+dmainit(void)
+{
+	Dma *d;
+
+	d = &physdma[0];
+	d->r[INTTCCLR] = 0xff;
+	d->r[INTERRCLR] = 0xff;
+	d->r[CONFIG] = DMACEN;
+	dma = d;
+}
+
+// wait for the transfer in flight to finish, the interrupt
+// tells us when it is done, but we also look at the channel
+// since interrupts may not be on yet
+void
+dmawait(void)
+{
+	while (dma->busy && (dma->r[C0CFG] & CE))
+		;
+	dma->busy = false;
+}
+
+// start a transfer of h rows of n bytes each, the rows are
+// sstride and dstride bytes apart. each row after the first
+// is a linked list item. returns false if the transfer can't
+// be done with words, the caller has to do it then
+static bool
+start(uchar *dst, int dstride, uchar *src, int sstride, int n, int h, u32 ctl)
+{
+	Lli *l;
+	int i;
+
+	if (((uintptr)dst | (uintptr)src | dstride | sstride | n) & 3)
+		return false;
+	if (n / 4 > COUNTMAX || h <= 0 || h > NLLI + 1)
+		return false;
+
+	dmawait();
+
+	ctl |= n / 4 | SBSIZE4 | DBSIZE4 | SWORD | DWORD | DI;
+	for (i = 1; i < h; i++) {
+		l = &lli[i - 1];
+		l->src = (uintptr)(src + i * sstride);
+		l->dst = (uintptr)(dst + i * dstride);
+		l->next = (i + 1 < h) ? (uintptr)&lli[i] : 0;
+		l->ctl = ctl;
+	}
+	if (h > 1)
+		lli[h - 2].ctl |= TCINT;
+	else
+		ctl |= TCINT;
+
+	dma->busy = true;
+	dma->r[C0SRC] = (uintptr)src;
+	dma->r[C0DST] = (uintptr)dst;
+	dma->r[C0LLI] = (h > 1) ? (uintptr)&lli[0] : 0;
+	dma->r[C0CTL] = ctl;
+	dma->r[C0CFG] = CE | IE | ITC;
+	return true;
+}
+
+// fill h rows of n bytes each with the word v,
+// the rows are stride bytes apart
+bool
+dmafill(void *dst, int stride, u32 v, int n, int h)
+{
+	// the source doesn't move, so every
+	// transfer reads the same word
+	dmawait();
+	dma->fill = v;
+	return start(dst, stride, (uchar *)&dma->fill, 0, n, h, 0);
+}
+
+// copy h rows of n bytes each from src to dst,
+// the rows are sstride and dstride bytes apart
+bool
+dmacopy(void *dst, int dstride, void *src, int sstride, int n, int h)
+{
+	return start(dst, dstride, src, sstride, n, h, SI);
+}
+
+// handle transfer done and error interrupts
+void
+dmaintr(Ureg *, void *a)
+{
+	Dma *d;
+	u32 err;
+
+	d = a;
+	err = d->r[INTERRSTAT];
+	d->r[INTTCCLR] = d->r[INTTCSTAT];
+	d->r[INTERRCLR] = err;
+	d->busy = false;
+
+	if (err)
+		iprint("dma error %x\n", err);
+}
@@ -3,27 +3,457 @@
 #include "dat.h"
 #include "fns.h"
 
+// clip rectangle r against rectangle b, returns false
+// if nothing of r is left inside of b
+bool
+rectclip(Rect *r, Rect b)
+{
+	int x0, y0, x1, y1;
+
+	x0 = max(r->x, b.x);
+	y0 = max(r->y, b.y);
+	x1 = min(r->x + r->w, b.x + b.w);
+	y1 = min(r->y + r->h, b.y + b.h);
+	if (x0 >= x1 || y0 >= y1)
+		return false;
+
+	*r = (Rect){x0, y0, x1 - x0, y1 - y0};
+	return true;
+}
+
+// returns true if the rectangles overlap
+static bool
+rectXrect(Rect a, Rect b)
+{
+	return a.x < b.x + b.w && b.x < a.x + a.w &&
+	       a.y < b.y + b.h && b.y < a.y + a.h;
+}
+
+// returns the smallest rectangle covering both rectangles
+static Rect
+rectunion(Rect a, Rect b)
+{
+	int x0, y0, x1, y1;
+
+	x0 = min(a.x, b.x);
+	y0 = min(a.y, b.y);
+	x1 = max(a.x + a.w, b.x + b.w);
+	y1 = max(a.y + a.h, b.y + b.h);
+	return (Rect){x0, y0, x1 - x0, y1 - y0};
+}
+
+// add a rectangle to a damage list, anything it
+// overlaps gets merged with it so the list never
+// has two rectangles covering the same pixels
+static void
+adddamage(Damage *d, Rect r)
+{
+	int i;
+
+again:
+	for (i = 0; i < d->n; i++) {
+		if (rectXrect(d->r[i], r)) {
+			r = rectunion(d->r[i], r);
+			d->r[i] = d->r[--d->n];
+			goto again;
+		}
+	}
+
+	// if we run out of space, fold everything
+	// into one rectangle covering all of it
+	if (d->n == nelem(d->r)) {
+		for (i = 0; i < d->n; i++)
+			r = rectunion(r, d->r[i]);
+		d->n = 0;
+	}
+	d->r[d->n++] = r;
+}
+
+// mark a region of the screen as needing a redraw,
+// each page keeps its own list since the page we draw
+// to next has missed the updates of the page on screen
+void
+damage(Rect r)
+{
+	int i;
+
+	if (!rectclip(&r, (Rect){0, 0, screen->w, screen->h}))
+		return;
+
+	for (i = 0; i < nelem(screen->dirty); i++)
+		adddamage(&screen->dirty[i], r);
+}
+
+// convert a 32 bit rgb color to a pixel of the given depth,
+// 16 bit is rgb565 and 8 bit indexes a 3-3-2 palette
+static u32
+rgbpixel(u32 c, int depth)
+{
+	switch (depth) {
+	case 8:
+		return ((c >> 16) & 0xe0) | ((c >> 11) & 0x1c) | ((c >> 6) & 0x3);
+	case 16:
+		return ((c >> 8) & 0xf800) | ((c >> 5) & 0x7e0) | ((c >> 3) & 0x1f);
+	}
+	return c;
+}
+
+// repeat a pixel of the given depth across a word
+static u32
+replicate(u32 p, int depth)
+{
+	switch (depth) {
+	case 8:
+		return p * 0x01010101;
+	case 16:
+		return p | (p << 16);
+	}
+	return p;
+}
+
+// store a pixel of the given depth at p
+static void
+storepixel(uchar *p, u32 v, int depth)
+{
+	switch (depth) {
+	case 8:
+		*p = v;
+		break;
+	case 16:
+		*(u16 *)p = v;
+		break;
+	default:
+		*(u32 *)p = v;
+		break;
+	}
+}
+
+// returns the address of a pixel on a page
+static uchar *
+pixaddr(uchar *page, int x, int y)
+{
+	return &page[y * screen->stride + x * (screen->depth / 8)];
+}
+
+// fill n bytes at p with the pixels replicated in v, the
+// unaligned ends are done a byte at a time and the rest
+// a word at a time
+static void
+fillspan(uchar *p, int n, u32 v)
+{
+	for (; n > 0 && ((uintptr)p & 3); n--, p++)
+		*p = v >> (8 * ((uintptr)p & 3));
+
+	memset32((u32 *)p, v, n / 4);
+	p += n & ~3;
+	n &= 3;
+
+	for (; n > 0; n--, p++)
+		*p = v >> (8 * ((uintptr)p & 3));
+}
+
+// copy n bytes from s to d, using word copies when both
+// line up the same way and halfword copies when they
+// are at least halfword aligned with each other. it goes
+// front to back, so d may overlap s if it is below it
+static void
+copyspan(uchar *d, uchar *s, int n)
+{
+	u16 *dh, *sh;
+
+	if (((uintptr)d & 3) == ((uintptr)s & 3)) {
+		for (; n > 0 && ((uintptr)d & 3); n--)
+			*d++ = *s++;
+
+		memcpy32((u32 *)d, (u32 *)s, n / 4);
+		d += n & ~3;
+		s += n & ~3;
+		n &= 3;
+	} else if (((uintptr)d & 1) == ((uintptr)s & 1)) {
+		if ((uintptr)d & 1) {
+			*d++ = *s++;
+			n--;
+		}
+
+		dh = (u16 *)d;
+		sh = (u16 *)s;
+		for (; n >= 2; n -= 2)
+			*dh++ = *sh++;
+		d = (uchar *)dh;
+		s = (uchar *)sh;
+	}
+
+	for (; n > 0; n--)
+		*d++ = *s++;
+}
+
 // sets a pixel on the screen
 void
 setpixel(int x, int y, u32 c)
 {
-	if (!(0 <= x && x < screen->w))
+	Rect *r;
+	uchar *p;
+
+	r = &screen->clipr;
+	if (!(r->x <= x && x < r->x + r->w))
 		return;
-	if (!(0 <= y && y < screen->h))
+	if (!(r->y <= y && y < r->y + r->h))
 		return;
 
-	screen->fb[y * screen->w + x] = c;
+	dmawait();
+	p = pixaddr(screen->fb, x, y);
+	storepixel(p, rgbpixel(c, screen->depth), screen->depth);
 }
 
 // draw a filled rectangle on the screen
 void
 fillrect(int x, int y, int w, int h, u32 c)
 {
-	int px, py;
+	Rect r;
+	uchar *p;
+	u32 v;
+	int n;
 
-	for (py = y; py < y + h; py++) {
-		for (px = x; px < x + w; px++) {
-			setpixel(px, py, c);
-		}
+	// clip once up front, so the inner loop
+	// can write whole rows without any checks
+	r = (Rect){x, y, w, h};
+	if (!rectclip(&r, screen->clipr))
+		return;
+
+	v = replicate(rgbpixel(c, screen->depth), screen->depth);
+	n = r.w * (screen->depth / 8);
+	p = pixaddr(screen->fb, r.x, r.y);
+
+	// big rectangles are handed off to the DMA engine
+	// so we can do something else while it is filled,
+	// it turns them down if the rows don't line up on words
+	if (n * r.h >= DMAMIN && dmafill(p, screen->stride, v, n, r.h))
+		return;
+
+	// we can't draw while the DMA engine is still
+	// working, it may be drawing under us
+	dmawait();
+
+	// a full width rectangle is contiguous in memory
+	// so it can be filled in one go
+	if (r.w == screen->w) {
+		fillspan(p, n * r.h, v);
+		return;
+	}
+
+	for (; r.h > 0; r.h--) {
+		fillspan(p, n, v);
+		p += screen->stride;
+	}
+}
+
+// software cursor, it is drawn on top of the page being
+// shown with the pixels under it saved, so it can move
+// around without the scene having to be redrawn
+static struct {
+	// where the cursor is on each page,
+	// an empty rectangle if it is not on it
+	Rect r[2];
+
+	// what was under the cursor on each page
+	uchar save[2][CURSORMAX * CURSORMAX * 4];
+} ovl;
+
+// put the cursor on a page, saving the pixels under it
+void
+cursorput(int page, Cursor *c)
+{
+	Rect r;
+	uchar *p, *s;
+	u32 v;
+	int n, y;
+
+	// anything bigger than what we can save is cut off
+	ovl.r[page] = (Rect){0, 0, 0, 0};
+	r = (Rect){c->x, c->y, min(c->w, CURSORMAX), min(c->h, CURSORMAX)};
+	if (!rectclip(&r, (Rect){0, 0, screen->w, screen->h}))
+		return;
+
+	ovl.r[page] = r;
+	v = replicate(rgbpixel(c->color, screen->depth), screen->depth);
+	n = r.w * (screen->depth / 8);
+	p = pixaddr(screen->page[page], r.x, r.y);
+	s = ovl.save[page];
+	for (y = 0; y < r.h; y++) {
+		copyspan(s, p, n);
+		fillspan(p, n, v);
+		p += screen->stride;
+		s += n;
+	}
+}
+
+// take the cursor off a page, putting back what was under it
+void
+cursorremove(int page)
+{
+	Rect r;
+	uchar *p, *s;
+	int n, y;
+
+	r = ovl.r[page];
+	n = r.w * (screen->depth / 8);
+	p = pixaddr(screen->page[page], r.x, r.y);
+	s = ovl.save[page];
+	for (y = 0; y < r.h; y++) {
+		copyspan(p, s, n);
+		p += screen->stride;
+		s += n;
+	}
+	ovl.r[page] = (Rect){0, 0, 0, 0};
+}
+
+// move the cursor on the page being shown, only
+// the pixels under the cursor get touched
+void
+cursormove(Cursor *c)
+{
+	int page;
+
+	page = screen->back ^ 1;
+	cursorremove(page);
+	cursorput(page, c);
+}
+
+// initializes a text console drawn at r on the screen, buf holds
+// the pixels of the console and has to be big enough for r at the
+// screen depth. glyphs are drawn into buf as characters come in,
+// the screen only gets a copy of it when the console is drawn
+void
+consinit(Console *c, Rect r, u32 fg, u32 bg, uchar *buf)
+{
+	uchar *b;
+	u32 f;
+	int d, i, j;
+
+	d = screen->depth;
+	c->cols = r.w / FONTW;
+	c->rows = r.h / FONTH;
+	c->r = (Rect){r.x, r.y, c->cols * FONTW, c->rows * FONTH};
+	c->x = c->y = 0;
+	c->p = buf;
+	c->stride = c->r.w * (d / 8);
+
+	// every nibble of glyph bits maps to
+	// 4 pixels of the foreground/background
+	f = rgbpixel(fg, d);
+	c->bg = replicate(rgbpixel(bg, d), d);
+	for (i = 0; i < 16; i++) {
+		b = (uchar *)c->expand[i];
+		for (j = 0; j < 4; j++)
+			storepixel(b + j * (d / 8), (i & (8 >> j)) ? f : c->bg, d);
+	}
+
+	fillspan(c->p, c->stride * c->r.h, c->bg);
+	damage(c->r);
+}
+
+// draw a glyph into the console buffer at character
+// position x, y. every row of glyph bits is expanded
+// to pixels two nibbles at a time
+static void
+consglyph(Console *c, int x, int y, int ch)
+{
+	extern uchar font[];
+	uchar *g;
+	u32 *p, *e;
+	int i, j, n;
+
+	if (ch < ' ' || ch > 0x7f)
+		ch = '?';
+
+	// # of words that 4 pixels take up
+	n = screen->depth / 8;
+	g = &font[(ch - ' ') * FONTH];
+	p = (u32 *)&c->p[y * FONTH * c->stride + x * FONTW * n];
+	for (i = 0; i < FONTH; i++) {
+		e = c->expand[g[i] >> 4];
+		for (j = 0; j < n; j++)
+			p[j] = e[j];
+
+		e = c->expand[g[i] & 0xf];
+		for (j = 0; j < n; j++)
+			p[n + j] = e[j];
+
+		p += c->stride / 4;
+	}
+}
+
+// move the console cursor to the next line,
+// scrolling the console up when we are at the bottom
+static void
+consnewline(Console *c)
+{
+	int n;
+
+	c->x = 0;
+	if (++c->y < c->rows)
+		return;
+
+	// move the pixels up a line of text and clear the last line,
+	// the copy is to lower addresses so it can go front to back
+	c->y = c->rows - 1;
+	n = FONTH * c->stride;
+	copyspan(c->p, c->p + n, c->y * n);
+	fillspan(c->p + c->y * n, n, c->bg);
+	damage(c->r);
+}
+
+// write a character to the console
+void
+consputc(Console *c, int ch)
+{
+	// consdraw may have the DMA engine
+	// still reading the console buffer
+	dmawait();
+
+	switch (ch) {
+	case '\n':
+		consnewline(c);
+		break;
+	case '\r':
+		c->x = 0;
+		break;
+	default:
+		if (c->x == c->cols)
+			consnewline(c);
+
+		consglyph(c, c->x, c->y, ch);
+		damage((Rect){c->r.x + c->x * FONTW, c->r.y + c->y * FONTH, FONTW, FONTH});
+		c->x++;
+		break;
+	}
+}
+
+// copy the console to the screen
+void
+consdraw(Console *c)
+{
+	Rect r;
+	uchar *d, *s;
+	int n;
+
+	r = c->r;
+	if (!rectclip(&r, screen->clipr))
+		return;
+
+	n = r.w * (screen->depth / 8);
+	d = pixaddr(screen->fb, r.x, r.y);
+	s = &c->p[(r.y - c->r.y) * c->stride + (r.x - c->r.x) * (screen->depth / 8)];
+
+	// big copies go to the DMA engine like big fills do,
+	// it turns them down if the rows don't line up on words
+	if (n * r.h >= DMAMIN && dmacopy(d, screen->stride, s, c->stride, n, r.h))
+		return;
+
+	dmawait();
+	for (; r.h > 0; r.h--) {
+		copyspan(d, s, n);
+		d += screen->stride;
+		s += c->stride;
 	}
 }
@@ -0,0 +1,67 @@
+// fill n words at p with the value c
+// void memset32(u32 *p, u32 c, ulong n)
+// R0    - p
+// FP[4] - c
+// FP[8] - n
+TEXT memset32(SB), 1, $-4
+	MOVW 4(FP), R2
+	MOVW 8(FP), R1
+
+	// spread the value over 8 registers so
+	// we can store 8 words with one instruction
+	MOVW R2, R3
+	MOVW R2, R4
+	MOVW R2, R5
+	MOVW R2, R6
+	MOVW R2, R7
+	MOVW R2, R8
+	MOVW R2, R11
+
+_fill8:
+	SUB.S $8, R1
+	BLT _fill1
+	MOVM.IA.W [R2-R8,R11], (R0)
+	B _fill8
+
+	// store the remaining words one at a time
+_fill1:
+	ADD.S $8, R1
+	BLE _filldone
+_fill1loop:
+	MOVW.P R2, 4(R0)
+	SUB.S $1, R1
+	BNE _fill1loop
+
+_filldone:
+	RET
+
+// copy n words from s to d, front to back. the buffers
+// may overlap only if d is below s, every word is read
+// before a store can reach it
+// void memcpy32(u32 *d, u32 *s, ulong n)
+// R0    - d
+// FP[4] - s
+// FP[8] - n
+TEXT memcpy32(SB), 1, $-4
+	MOVW 4(FP), R1
+	MOVW 8(FP), R2
+
+_copy4:
+	SUB.S $4, R2
+	BLT _copy1
+	MOVM.IA.W (R1), [R3-R6]
+	MOVM.IA.W [R3-R6], (R0)
+	B _copy4
+
+	// copy the remaining words one at a time
+_copy1:
+	ADD.S $4, R2
+	BLE _copydone
+_copy1loop:
+	MOVW.P 4(R1), R3
+	MOVW.P R3, 4(R0)
+	SUB.S $1, R2
+	BNE _copy1loop
+
+_copydone:
+	RET
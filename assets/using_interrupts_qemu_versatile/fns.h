@@ -1,32 +1,73 @@
 void uartputc(Uart *, int);
 void uartinit(void);
+void uartirq(Uart *);
+void uartpolled(Uart *);
+void uartintr(Ureg *, void *);
 
 void clcdinit(void);
 void clcddisable(Clcd *);
 void clcdenable(Clcd *);
+void clcdflip(Clcd *);
+void clcdvsync(Clcd *);
+
+void dmainit(void);
+void dmawait(void);
+bool dmafill(void *, int, u32, int, int);
+bool dmacopy(void *, int, void *, int, int, int);
 
 void inputinit(void);
-void pollinput(u32 *, u32 *);
-void updatecursor(Cursor *, u32);
+int getevents(Event *, int);
+bool keydown(int);
+void updatecursor(Cursor *, int, int);
 
 void setpixel(int, int, u32);
 void fillrect(int, int, int, int, u32);
+bool rectclip(Rect *, Rect);
+void damage(Rect);
+void cursorput(int, Cursor *);
+void cursorremove(int);
+void cursormove(Cursor *);
+void consinit(Console *, Rect, u32, u32, uchar *);
+void consputc(Console *, int);
+void consdraw(Console *);
+int cprint(Console *, char *, ...);
+void memset32(u32 *, u32, ulong);
+void memcpy32(u32 *, u32 *, ulong);
 
 void timerinit(void);
 void delay(int);
 void microdelay(int);
+u32 usec(void);
+void proftimer(int);
+uvlong fastticks(uvlong *);
+vlong nsec(void);
 
-void schedevent(u32);
+void addalarm(Alarm *, u32);
+void delalarm(Alarm *);
 void event(void);
 
 void trapinit(void);
 void intrsoff(void);
 void intrson(void);
-void intrenable(int, void (*)(Ureg *, void *), void *, char *);
+void intrenable(int, int, void (*)(Ureg *, void *), void *, char *);
+void sicenable(int, void (*)(Ureg *, void *), void *, char *);
+void fiqenable(int);
+void softintr(int);
+void softintrclr(int);
+void intrstats(void);
+void syscall(Ureg *);
+int swinop(void);
+u32 swiusec(void);
+ulong switicks(void);
+int swiwrite(char *, int);
+bool queuework(Work *);
+void runwork(void);
 
 void timerintr(Ureg *, void *);
 void timeroneintr(Ureg *, void *);
 void inputinr(Ureg *, void *);
+void clcdintr(Ureg *, void *);
+void dmaintr(Ureg *, void *);
 
 void cacheuwbinv(void);
 void coherence(void);
@@ -39,4 +80,12 @@ int spllo(void);
 int splhi(void);
 int splx(int);
 
+int clz(u32);
+void idle(void);
+void _start(void);
+
+void profinit(int);
+void profsample(Ureg *);
+void profdump(void);
+
 #define round(x, r) (((x) + ((r)-1)) & ~(r))
@@ -59,48 +59,299 @@ reset(Input *p)
 void
 inputinit(void)
 {
-	reset(&physinput[0]);
-	reset(&physinput[1]);
+	kbd = &physinput[0];
+	mouse = &physinput[1];
+	reset(kbd);
+	reset(mouse);
 }
 
-// polls for input if there is no input
-// set events to 0
-void
-pollinput(u32 *kb, u32 *ms)
+// # of bytes waiting in the ring
+static ulong
+avail(Input *p)
 {
-	Input *p;
-	int i;
+	return p->wp - p->rp;
+}
+
+// take the next byte out of the ring
+static u32
+getbyte(Input *p)
+{
+	u32 v;
+
+	v = p->buf[p->rp & (NINBUF - 1)];
+	p->rp++;
+	return v;
+}
+
+// mouse status byte bits
+enum {
+	MBUTTONS = 0x7,
+	MSYNC = 1 << 3,
+	MXSIGN = 1 << 4,
+	MYSIGN = 1 << 5,
+	MXOVER = 1 << 6,
+	MYOVER = 1 << 7,
+};
+
+// keyboard prefix bytes seen
+enum {
+	KBREAK = 1 << 0,
+	KEXT = 1 << 1,
+};
+
+// scan code set 2 to key codes, codes
+// that are not in here are ignored
+static const uchar kbtab[0x84] = {
+    [0x01] = KF9,
+    [0x03] = KF5,
+    [0x04] = KF3,
+    [0x05] = KF1,
+    [0x06] = KF2,
+    [0x07] = KF12,
+    [0x09] = KF10,
+    [0x0a] = KF8,
+    [0x0b] = KF6,
+    [0x0c] = KF4,
+    [0x0d] = KTAB,
+    [0x0e] = '`',
+    [0x11] = KLALT,
+    [0x12] = KLSHIFT,
+    [0x14] = KLCTL,
+    [0x15] = 'q',
+    [0x16] = '1',
+    [0x1a] = 'z',
+    [0x1b] = 's',
+    [0x1c] = 'a',
+    [0x1d] = 'w',
+    [0x1e] = '2',
+    [0x21] = 'c',
+    [0x22] = 'x',
+    [0x23] = 'd',
+    [0x24] = 'e',
+    [0x25] = '4',
+    [0x26] = '3',
+    [0x29] = ' ',
+    [0x2a] = 'v',
+    [0x2b] = 'f',
+    [0x2c] = 't',
+    [0x2d] = 'r',
+    [0x2e] = '5',
+    [0x31] = 'n',
+    [0x32] = 'b',
+    [0x33] = 'h',
+    [0x34] = 'g',
+    [0x35] = 'y',
+    [0x36] = '6',
+    [0x3a] = 'm',
+    [0x3b] = 'j',
+    [0x3c] = 'u',
+    [0x3d] = '7',
+    [0x3e] = '8',
+    [0x41] = ',',
+    [0x42] = 'k',
+    [0x43] = 'i',
+    [0x44] = 'o',
+    [0x45] = '0',
+    [0x46] = '9',
+    [0x49] = '.',
+    [0x4a] = '/',
+    [0x4b] = 'l',
+    [0x4c] = ';',
+    [0x4d] = 'p',
+    [0x4e] = '-',
+    [0x52] = '\'',
+    [0x54] = '[',
+    [0x55] = '=',
+    [0x58] = KCAPS,
+    [0x59] = KRSHIFT,
+    [0x5a] = KENTER,
+    [0x5b] = ']',
+    [0x5d] = '\\',
+    [0x66] = KBS,
+    [0x76] = KESC,
+    [0x78] = KF11,
+    [0x83] = KF7,
+};
+
+// the same for the codes that come after a 0xe0
+static const uchar kbtabext[0x80] = {
+    [0x11] = KRALT,
+    [0x14] = KRCTL,
+    [0x5a] = KENTER,
+    [0x69] = KEND,
+    [0x6b] = KLEFT,
+    [0x6c] = KHOME,
+    [0x70] = KINS,
+    [0x71] = KDEL,
+    [0x72] = KDOWN,
+    [0x74] = KRIGHT,
+    [0x75] = KUP,
+    [0x7a] = KPGDN,
+    [0x7d] = KPGUP,
+};
 
-	*kb = *ms = 0;
-	for (i = 0; i < nelem(physinput); i++) {
-		p = &physinput[i];
-		if (!(p->r[STAT] & RXFULL))
+// keys being held down, a bit per key code
+static u32 keys[256 / 32];
+
+// is key k being held down
+bool
+keydown(int k)
+{
+	return (keys[(k >> 5) & 7] >> (k & 31)) & 1;
+}
+
+// turn keyboard bytes into key events, a 0xf0 before
+// the code means the key went up and a 0xe0 that it is
+// one of the extended keys. the pause key sends 0xe1 and
+// 7 more bytes, all of which get skipped
+static int
+kbdevents(Input *p, Event *e, int n)
+{
+	u32 c;
+	int i, k;
+
+	for (i = 0; i < n && avail(p) > 0;) {
+		c = getbyte(p);
+		if (p->skip > 0) {
+			p->skip--;
+			continue;
+		}
+
+		switch (c) {
+		case 0xf0:
+			p->prefix |= KBREAK;
+			continue;
+		case 0xe0:
+			p->prefix |= KEXT;
 			continue;
+		case 0xe1:
+			p->skip = 7;
+			continue;
+		}
 
-		if (i == 0) {
-			// keyboard just gets raw data
-			// ignore 0xf0, that is a "end marker"
-			*kb = p->r[DATA];
-			if (*kb == 0xf0)
-				*kb = 0;
+		k = 0;
+		if (p->prefix & KEXT) {
+			if (c < nelem(kbtabext))
+				k = kbtabext[c];
 		} else {
-			// mouse gets 3 packet, the
-			// status, dx, dy
-			*ms |= p->r[DATA];
-			*ms |= (p->r[DATA] << 8);
-			*ms |= (p->r[DATA] << 16);
+			if (c < nelem(kbtab))
+				k = kbtab[c];
 		}
+		if (k == 0) {
+			p->prefix = 0;
+			continue;
+		}
+
+		e[i].type = EVKEY;
+		e[i].key = k;
+		e[i].down = !(p->prefix & KBREAK);
+		if (e[i].down)
+			keys[k >> 5] |= 1 << (k & 31);
+		else
+			keys[k >> 5] &= ~(1 << (k & 31));
+		p->prefix = 0;
+		i++;
 	}
+	return i;
+}
+
+// turn mouse bytes into mouse events, they come in 3 byte
+// packets of the status, dx and dy. a packet that is
+// not all there yet stays in p->pkt until it is. runs of
+// packets with the same buttons held get added up into
+// one event, so a flood of movement moves the cursor once.
+// a packet that needs a new event when e is full waits
+// in p->pend for the next call
+static int
+mouseevents(Input *p, Event *e, int n)
+{
+	int i, b, dx, dy;
+	u32 c;
+
+	i = 0;
+	if (p->haspend) {
+		if (n == 0)
+			return 0;
+		e[i++] = p->pend;
+		p->haspend = false;
+	}
+
+	while (avail(p) > 0) {
+		// the status byte always has MSYNC set, a byte that comes
+		// first without it means we lost one, skip ahead until
+		// we find what looks like the start of a packet again
+		c = getbyte(p);
+		if (p->npkt == 0 && !(c & MSYNC)) {
+			p->resync++;
+			continue;
+		}
+
+		p->pkt[p->npkt++] = c;
+		if (p->npkt < nelem(p->pkt))
+			continue;
+		p->npkt = 0;
+
+		// the movement is 9 bits, the sign is in the status
+		// byte. on overflow go as far as we can that way
+		b = p->pkt[0];
+		dx = p->pkt[1];
+		dy = p->pkt[2];
+		if (b & MXSIGN)
+			dx -= 256;
+		if (b & MYSIGN)
+			dy -= 256;
+		if (b & MXOVER)
+			dx = (b & MXSIGN) ? -256 : 255;
+		if (b & MYOVER)
+			dy = (b & MYSIGN) ? -256 : 255;
+
+		// the mouse has y going up
+		dy = -dy;
+
+		b &= MBUTTONS;
+		if (i > 0 && e[i - 1].buttons == b) {
+			e[i - 1].dx += dx;
+			e[i - 1].dy += dy;
+			continue;
+		}
+
+		if (i < n) {
+			e[i].type = EVMOUSE;
+			e[i].buttons = b;
+			e[i].dx = dx;
+			e[i].dy = dy;
+			i++;
+			continue;
+		}
+
+		p->pend.type = EVMOUSE;
+		p->pend.buttons = b;
+		p->pend.dx = dx;
+		p->pend.dy = dy;
+		p->haspend = true;
+		break;
+	}
+	return i;
+}
+
+// get up to n decoded events out of what the
+// interrupts have read, returns the # of events
+int
+getevents(Event *e, int n)
+{
+	int i;
+
+	i = kbdevents(kbd, e, n);
+	i += mouseevents(mouse, e + i, n - i);
+	return i;
 }
 
 // move the cursor based on the mouse movement
 void
-updatecursor(Cursor *c, u32 ms)
+updatecursor(Cursor *c, int dx, int dy)
 {
-	// move x and y, the mouse events
-	// switches the y coordinates around
-	c->dx = (s8)((ms >> 8) & 0xff);
-	c->dy = -(s8)((ms >> 16) & 0xff);
+	c->dx = dx;
+	c->dy = dy;
 	c->x += c->dx;
 	c->y += c->dy;
 
@@ -115,11 +366,28 @@ updatecursor(Cursor *c, u32 ms)
 		c->y = 0;
 	if (c->y + c->h >= screen->h)
 		c->y = screen->h - c->h;
+
+	// put the cursor at the new spot
+	// on the screen right away
+	if (c->dx || c->dy)
+		cursormove(c);
+}
+
+static void
+inputwork(void *)
+{
+	event();
 }
 
-// input interrupt
+// decoding the bytes and moving the cursor
+// happens outside of the interrupt
+static Work work = {inputwork};
+
+// input interrupt, raised by _vfiq
+// once it has bytes for us
 void
 inputinr(Ureg *, void *)
 {
-	event();
+	softintrclr(SWIRQ);
+	queuework(&work);
 }
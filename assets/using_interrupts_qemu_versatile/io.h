@@ -28,4 +28,18 @@ enum {
 	VIC27IRQ,
 	VIC28IRQ,
 	VIC31IRQ = 31,
-};
\ No newline at end of file
+};
+
+// secondary interrupt controller lines
+enum {
+	SICSOFTIRQ = 0,
+	MMCI0BIRQ,
+	MMCI1BIRQ,
+	KMI0IRQ,
+	KMI1IRQ,
+	SCI1IRQ,
+	UART3IRQ,
+	CHARLCDIRQ,
+	TOUCHIRQ,
+	KEYPADIRQ,
+};
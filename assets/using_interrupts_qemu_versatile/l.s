@@ -49,3 +49,18 @@ TEXT splx(SB), 1, $-4
 	MOVW	CPSR, R0
 	MOVW	R1, CPSR
 	RET
+
+// wait for an interrupt, the cpu sleeps until
+// one is pending even when they are masked
+TEXT idle(SB), 1, $-4
+	MOVW $0, R0
+	MCR CpSC, 0, R0, C(CpCACHE), C(CpCACHEintr), CpCACHEwait
+	RET
+
+// count the leading zero bits
+// int clz(u32)
+TEXT clz(SB), 1, $-4
+	// CLZ R0, R0, encoded by hand for
+	// assemblers that predate ARMv5
+	WORD $0xe16f0f10
+	RET
@@ -38,8 +38,83 @@ TEXT _vund(SB), 1, $-4
 	B _vswitch
 
 // swi interrupt vector
+// the call # is the immediate of the swi and the arguments
+// are in R0-R3, the result goes back in R0. calls marked fast
+// in systab get called right away like any C function,
+// the rest get a ureg built for them like _vswitch does
 TEXT _vsvc(SB), 1, $-4
-	B 0(PC)
+	// keep the return address and the caller psr,
+	// a swi made from inside a call would lose them
+	MOVM.DB.W [R14], (R13)
+	MOVW SPSR, R14
+	MOVM.DB.W [R14], (R13)
+
+	// the arguments go where C expects them, R0 stays
+	// as is and the rest start at 8(R13), past the slot
+	// that 0(R13) keeps for the callee's return address
+	MOVM.DB.W [R0-R3], (R13)
+	SUB $4, R13
+
+	// R1 = call #, the low 24 bits of the swi
+	MOVW 24(R13), R14
+	MOVW -4(R14), R1
+	BIC $0xff000000, R1
+
+	// bad call #s are left to the slow path to complain about
+	MOVW nsyscall(SB), R2
+	CMP R2, R1
+	BHS _sysslow
+
+	// R3 = systab[R1].fast
+	MOVW $systab(SB), R2
+	ADD R1<<3, R2
+	MOVW 0(R2), R3
+	CMP $0, R3
+	BEQ _sysslow
+
+	// fast path, call it with R0-R3 and nothing else saved
+	BL (R3)
+
+	// pop the link slot and the arguments and
+	// restore the caller psr, the result is in R0
+	ADD $20, R13
+	MOVM.IA.W (R13), [R14]
+	MOVW R14, SPSR
+
+	// return to the caller
+	RFE
+
+_sysslow:
+	// get the arguments back and put ureg->type
+	// below the psr and return address we saved,
+	// that makes up ureg->{type, psr, pc}
+	ADD $4, R13
+	MOVM.IA.W (R13), [R0-R3]
+	MOVW $PsrMsvc, R14
+	MOVM.DB.W [R14], (R13)
+	MOVW 8(R13), R14
+
+	// save the registers, at end r13 points to ureg
+	MOVM.DB	[R0-R14], (R13)
+	SUB	$(15*4), R13
+
+	// first arg is pointer to ureg
+	MOVW R13, R0
+	BL syscall(SB)
+
+	// make r13 point to ureg->type
+	ADD	$(4*15), R13
+
+	// restore SPSR
+	MOVW 4(R13), R0
+	MOVW R0, SPSR
+
+	// restore registers, R0 has the result
+	MOVM.DB (R13), [R0-R14]
+	// pop past ureg->{type+psr} to pc
+	ADD	$(4*2), R13
+
+	// return from exception
 	RFE
 
 // prefetch abort vector
@@ -125,10 +200,80 @@ _vswitch:
 	// return from exception
 	RFE
 
-// fiq vector
+// offsets into Input, the ring fields go first, see dat.h
+#define INR 0
+#define INRP 4
+#define INWP 8
+#define INOVERRUN 12
+#define INBUF 16
+#define NINBUF 256
+
+// ps2 status and data registers and the bit
+// telling there is a byte to read, see input.c
+#define KMISTAT 4
+#define KMIDATA 8
+#define KMIRXFULL 0x10
+
+// where to write to raise the input software interrupt
+#define VICSOFTINT 0x10140018
+#define SWIRQBIT 0x2
+
+// fiq vector, only the ps2 lines come in on it. their bytes
+// are moved into the rings of kbd and mouse and the software
+// interrupt is raised for the rest of the input handling.
+// R8-R14 are banked in fiq mode, so the handler uses
+// only those and saves nothing. R14 is the return address.
+// R8 = the Input, R9 = its registers, R10 = its wp,
+// R11 = the next Input to do, R12 and R13 scratch
 TEXT _vfiq(SB), 1, $-4
-	B 0(PC)
-	RFE
+	// R12 is banked too, give it the static base to get at kbd/mouse
+	MOVW $setR12(SB), R12
+	MOVW kbd(SB), R8
+	MOVW mouse(SB), R11
+
+_fiqdev:
+	MOVW INR(R8), R9
+	MOVW INWP(R8), R10
+
+_fiqbyte:
+	MOVW KMISTAT(R9), R12
+	TST $KMIRXFULL, R12
+	BEQ _fiqdevdone
+
+	// reading the byte clears the interrupt,
+	// drop it if the ring is full
+	MOVW KMIDATA(R9), R12
+	MOVW INRP(R8), R13
+	SUB R13, R10, R13
+	CMP $NINBUF, R13
+	BHS _fiqoverrun
+
+	AND $(NINBUF-1), R10, R13
+	ADD R8, R13
+	MOVB R12, INBUF(R13)
+	ADD $1, R10
+	B _fiqbyte
+
+_fiqoverrun:
+	MOVW INOVERRUN(R8), R13
+	ADD $1, R13
+	MOVW R13, INOVERRUN(R8)
+	B _fiqbyte
+
+_fiqdevdone:
+	// publish the bytes, then go on to the mouse
+	MOVW R10, INWP(R8)
+	MOVW R11, R8
+	MOVW $0, R11
+	CMP $0, R8
+	BNE _fiqdev
+
+	MOVW $VICSOFTINT, R12
+	MOVW $SWIRQBIT, R13
+	MOVW R13, (R12)
+
+	// return to the interrupted instruction and restore the cpsr
+	SUB.S $4, R14, R15
 
 // set the stack value for the mode passed in R0
 TEXT setr13(SB), 1, $-4
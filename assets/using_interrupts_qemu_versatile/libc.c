@@ -100,6 +100,9 @@ vxprint(char *fmt, va_list ap, char *str, ulong size, bool cons)
 			s = va_arg(ap, char *);
 			vxputs(s, &n, str, size, cons);
 			break;
+		case '%':
+			vxputc('%', &n, str, size, cons);
+			break;
 		case '\0':
 			return n;
 		}
@@ -157,6 +160,21 @@ iprint(char *fmt, ...)
 	return n;
 }
 
+int
+cprint(Console *c, char *fmt, ...)
+{
+	char buf[128];
+	va_list ap;
+	int i, n;
+
+	va_start(ap, fmt);
+	n = vsnprint(buf, sizeof(buf), fmt, ap);
+	va_end(ap);
+	for (i = 0; i < n && i < sizeof(buf); i++)
+		consputc(c, buf[i]);
+	return n;
+}
+
 int
 putchar(int c)
 {
@@ -245,6 +263,10 @@ panic(char *fmt, ...)
 {
 	va_list ap;
 
+	// the uart interrupt won't be coming
+	splhi();
+	uartpolled(consuart);
+
 	print("panic: ");
 	va_start(ap, fmt);
 	vprint(fmt, ap);
@@ -7,60 +7,206 @@
 Cursor cursor = {
     .w = 15,
     .h = 15,
+    .color = 0xff00ff00,
 };
 
 // our screen
 Clcd *screen;
 
+// DMA engine used for drawing
+Dma *dma;
+
+// ps2 keyboard and mouse
+Input *kbd;
+Input *mouse;
+
+// text console at the bottom of the screen for stats,
+// the buffer is big enough for 4 lines at 32 bit color
+static Console cons;
+static u32 consbuf[640 * 32];
+
+// alarm that goes off a second later each time around
+static Alarm alarm;
+static u32 alarmms = 1000;
+
+static void
+alarmmsg(void *)
+{
+	print("timer #2 one shot interrupt\n");
+}
+
+static Work alarmwork = {alarmmsg};
+
+static void
+ring(Alarm *a)
+{
+	queuework(&alarmwork);
+
+	alarmms += 1000;
+	if (alarmms >= 1000 * 1000)
+		alarmms = 1000;
+	addalarm(a, alarmms * 1000);
+}
+
+// # of frames drawn since the stats were last shown,
+// and the microseconds spent redrawing them
+static int frames;
+static u32 drawus;
+
 // get keyboard and mouse events
 void
 event(void)
 {
-	u32 kb, ms;
+	Event ev[16], *e;
+	int i, n;
 
-	for (;;) {
-		pollinput(&kb, &ms);
-		if (kb == 0 && ms == 0)
-			break;
+	while ((n = getevents(ev, nelem(ev))) > 0) {
+		for (i = 0; i < n; i++) {
+			e = &ev[i];
+			switch (e->type) {
+			case EVMOUSE:
+				updatecursor(&cursor, e->dx, e->dy);
+				break;
 
-		updatecursor(&cursor, ms);
+			case EVKEY:
+				if (!e->down)
+					break;
+				print("key %x\n", e->key);
 
-		if (kb)
-			print("key %x\n", kb);
+				// p sends the profile over the uart
+				if (e->key == 'p')
+					profdump();
+				break;
+			}
+		}
 	}
 }
 
+// time a w by h fill done a pixel at a time through setpixel,
+// the way fillrect used to, against fillrect itself
 static void
-draw(void)
+fillbench(int w, int h)
+{
+	u32 t0, t1, t2;
+	int x, y;
+
+	t0 = usec();
+	for (y = 0; y < h; y++)
+		for (x = 0; x < w; x++)
+			setpixel(x, y, 0xff555555);
+	t1 = usec();
+	fillrect(0, 0, w, h, 0xff555555);
+	dmawait();
+	t2 = usec();
+
+	print("fill %dx%d: setpixel %u us, fillrect %u us\n", w, h, t1 - t0, t2 - t1);
+}
+
+// go through each system call once, the swi
+// paths are not used anywhere else
+static void
+swicheck(void)
 {
-	Rect r;
+	static char msg[] = "system calls ok\n";
+	u32 t0, t1, t2;
+	ulong n;
+	int r;
+
+	if ((r = swinop()) != 0)
+		panic("swinop returned %d", r);
+
+	t0 = usec();
+	t1 = swiusec();
+	t2 = usec();
+	if (t1 - t0 > t2 - t0)
+		panic("swiusec returned %u, not between %u and %u", t1, t0, t2);
 
-	// disable the screen so we can draw to it
-	// if we enable the screen while drawing, it can cause
-	// the update to show partial updates, where as we want
-	// something like double buffering, this achieves something
-	// like double-buffering
-	clcddisable(screen);
+	n = ticks;
+	if (switicks() - n > 1)
+		panic("switicks is off from %u", n);
 
+	if ((r = swiwrite(msg, sizeof(msg) - 1)) != sizeof(msg) - 1)
+		panic("swiwrite returned %d", r);
+}
+
+// draw the scene, only the parts inside
+// of screen->clipr get touched
+static void
+redraw(void)
+{
 	// clear to a gray background
 	fillrect(0, 0, screen->w, screen->h, 0xff555555);
 
-	// draw our cursor
-	fillrect(cursor.x, cursor.y, cursor.w, cursor.h, 0xff00ff00);
+	// stats on top of everything
+	consdraw(&cons);
+}
+
+// show the frame rate, how long a frame took to
+// redraw and how much of the time was spent
+// sleeping once a second
+static void
+stats(void)
+{
+	static ulong last, lastidle;
+
+	if (ticks == last)
+		return;
+
+	cprint(&cons, "\n%d frames/s, %u us/frame, %d%% idle", frames / (ticks - last), frames ? drawus / frames : 0, (idleus - lastidle) / (10000 * (ticks - last)));
+	frames = 0;
+	drawus = 0;
+	last = ticks;
+	lastidle = idleus;
+
+	// see where the interrupt time goes every so often
+	if (ticks % 10 == 0)
+		intrstats();
+}
+
+static void
+draw(void)
+{
+	Damage *d;
+	u32 t0;
+	int i;
+
+	// nothing changed on the page we are
+	// drawing to, wait for the next frame
+	d = &screen->dirty[screen->back];
+	if (d->n == 0) {
+		clcdvsync(screen);
+		return;
+	}
+
+	// only redraw the parts of the screen that changed
+	t0 = usec();
+	for (i = 0; i < d->n; i++) {
+		screen->clipr = d->r[i];
+		redraw();
+	}
+	d->n = 0;
+	screen->clipr = (Rect){0, 0, screen->w, screen->h};
+
+	// the DMA engine may still be drawing to the page
+	dmawait();
+	drawus += usec() - t0;
 
-	// draw the device, we need to delay a little so QEMU can have a chance to refresh
-	// if we do not have a delay, QEMU can get into a execution path where it only
-	// sees the disable and not the enable when it decides to refresh, thus giving
-	// us a black screen.
-	clcdenable(screen);
-	delay(5);
+	// the cursor is not part of the scene, event() moves it
+	// around on the page being shown. put it on the page we are
+	// about to show and take it off the page we will draw to next.
+	// we always draw to the page that is not on the screen so partial
+	// updates are never seen. event() runs from runwork() in this
+	// same loop, so it can't get at the cursor while we do this
+	cursorput(screen->back, &cursor);
+	clcdflip(screen);
+	cursorremove(screen->back);
+
+	frames++;
 }
 
 void
 main(void)
 {
-	u32 sc;
-
 	// setup UART for printing to terminal
 	uartinit();
 
@@ -70,24 +216,44 @@ main(void)
 	// setup timer so we can sleep
 	timerinit();
 
+	// sample where the time goes
+	profinit(1000);
+
+	// setup DMA so drawing can be offloaded
+	dmainit();
+
 	// setup the display so we can draw to the screen
 	clcdinit();
 
+	// see how long filling takes, the page
+	// drawn to gets cleared again by the first frame
+	fillbench(screen->w, screen->h);
+	fillbench(32, 32);
+
 	// setup keyboard and mouse
 	inputinit();
 
 	// enable interrupts
 	intrson();
 
+	// the system calls take arguments and
+	// return results the way they should
+	swicheck();
+
+	// setup the stats console
+	consinit(&cons, (Rect){0, screen->h - 32, screen->w, 32}, 0xffffffff, 0xff000000, (uchar *)consbuf);
+
+	// draw everything the first time around
+	damage((Rect){0, 0, screen->w, screen->h});
+
+	// start the alarm going
+	alarm.f = ring;
+	addalarm(&alarm, alarmms * 1000);
+
 	// game style loop
-	sc = 1000;
 	for (;;) {
-		if (!scheduled) {
-			schedevent(sc);
-			sc += 1000;
-			if (sc >= 1000 * 1000)
-				sc = 1000;
-		}
+		runwork();
+		stats();
 		draw();
 	}
 }
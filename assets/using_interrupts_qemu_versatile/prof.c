@@ -0,0 +1,83 @@
+#include "u.h"
+#include "libc.h"
+#include "dat.h"
+#include "fns.h"
+
+enum {
+	// each bin covers 1<<PROFSHIFT bytes of text,
+	// 4 instructions, starting at _start
+	PROFSHIFT = 4,
+	NPROF = 8192,
+};
+
+// pc samples taken by the profiling timer
+static struct {
+	uintptr base;
+	u32 bins[NPROF];
+	ulong outside;
+} prof;
+
+// sample the pc hz times a second
+void
+profinit(int hz)
+{
+	prof.base = (uintptr)_start;
+	proftimer(hz);
+}
+
+// called from the timer interrupt with
+// the registers of the code it interrupted
+void
+profsample(Ureg *ureg)
+{
+	uintptr i;
+
+	i = (ureg->pc - prof.base) >> PROFSHIFT;
+	if (i < NPROF)
+		prof.bins[i]++;
+	else
+		prof.outside++;
+}
+
+static void
+putw(u32 v)
+{
+	uartputc(consuart, v);
+	uartputc(consuart, v >> 8);
+	uartputc(consuart, v >> 16);
+	uartputc(consuart, v >> 24);
+}
+
+// send the samples over the uart and start over. the dump is
+// "PROF", then the # of samples outside of the bins and the
+// # of records, followed by the records, each the pc at the start
+// of a bin and its count. all words are 32 bit little endian,
+// prof.py turns it into a listing by function
+void
+profdump(void)
+{
+	int i, n, s;
+
+	s = splhi();
+	n = 0;
+	for (i = 0; i < NPROF; i++) {
+		if (prof.bins[i])
+			n++;
+	}
+
+	uartputc(consuart, 'P');
+	uartputc(consuart, 'R');
+	uartputc(consuart, 'O');
+	uartputc(consuart, 'F');
+	putw(prof.outside);
+	putw(n);
+	for (i = 0; i < NPROF; i++) {
+		if (prof.bins[i] == 0)
+			continue;
+		putw(prof.base + (i << PROFSHIFT));
+		putw(prof.bins[i]);
+		prof.bins[i] = 0;
+	}
+	prof.outside = 0;
+	splx(s);
+}
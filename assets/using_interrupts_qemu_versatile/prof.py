@@ -0,0 +1,50 @@
+#!/usr/bin/env python3
+# turn a profile dumped by profdump into a listing by function
+# usage: prof.py dump symbols
+#	dump is the serial output, e.g. ./run.sh | tee dump
+#	symbols is the link map from nm -n plan9.out
+
+import bisect
+import struct
+import sys
+
+def symbols(name):
+	addrs, names = [], []
+	for line in open(name):
+		f = line.split()
+		if len(f) != 3 or f[1] not in "TtLl":
+			continue
+		addrs.append(int(f[0], 16))
+		names.append(f[2])
+	return addrs, names
+
+def samples(name):
+	data = open(name, "rb").read()
+	i = data.rfind(b"PROF")
+	if i < 0:
+		sys.exit("no profile in " + name)
+	outside, n = struct.unpack_from("<II", data, i + 4)
+	recs = struct.unpack_from("<%dI" % (2 * n), data, i + 12)
+	return outside, zip(recs[0::2], recs[1::2])
+
+def main():
+	if len(sys.argv) != 3:
+		sys.exit("usage: prof.py dump symbols")
+
+	addrs, names = symbols(sys.argv[2])
+	outside, recs = samples(sys.argv[1])
+
+	count = {}
+	total = outside
+	for pc, n in recs:
+		i = bisect.bisect_right(addrs, pc) - 1
+		sym = names[i] if i >= 0 else "?"
+		count[sym] = count.get(sym, 0) + n
+		total += n
+	if outside:
+		count["(outside)"] = outside
+
+	for sym, n in sorted(count.items(), key=lambda x: -x[1]):
+		print("%6.2f%% %8d %s" % (100.0 * n / total, n, sym))
+
+main()
@@ -0,0 +1,5 @@
+// system call #s, they go in the swi immediate
+#define SYSNOP 0
+#define SYSUSEC 1
+#define SYSTICKS 2
+#define SYSWRITE 3
@@ -0,0 +1,34 @@
+#include "sys.h"
+
+// the calling side of the system calls, the first argument
+// is already in R0 and the next ones go in R1-R3. the swi
+// overwrites R14 when called from svc mode, so keep it on the stack
+
+// int swinop(void)
+TEXT swinop(SB), 1, $-4
+	MOVM.DB.W [R14], (R13)
+	SWI $SYSNOP
+	MOVM.IA.W (R13), [R14]
+	RET
+
+// u32 swiusec(void)
+TEXT swiusec(SB), 1, $-4
+	MOVM.DB.W [R14], (R13)
+	SWI $SYSUSEC
+	MOVM.IA.W (R13), [R14]
+	RET
+
+// ulong switicks(void)
+TEXT switicks(SB), 1, $-4
+	MOVM.DB.W [R14], (R13)
+	SWI $SYSTICKS
+	MOVM.IA.W (R13), [R14]
+	RET
+
+// int swiwrite(char *, int)
+TEXT swiwrite(SB), 1, $-4
+	MOVW 4(FP), R1
+	MOVM.DB.W [R14], (R13)
+	SWI $SYSWRITE
+	MOVM.IA.W (R13), [R14]
+	RET
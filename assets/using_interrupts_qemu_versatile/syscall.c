@@ -0,0 +1,74 @@
+#include "u.h"
+#include "libc.h"
+#include "dat.h"
+#include "fns.h"
+#include "sys.h"
+
+static ulong
+sysnop(ulong, ulong, ulong, ulong)
+{
+	return 0;
+}
+
+static ulong
+sysusec(ulong, ulong, ulong, ulong)
+{
+	return usec();
+}
+
+static ulong
+systicks(ulong, ulong, ulong, ulong)
+{
+	return ticks;
+}
+
+// write n bytes from p to the console
+static ulong
+syswrite(Ureg *ureg)
+{
+	char *p;
+	int i, n;
+
+	p = (char *)ureg->r0;
+	n = ureg->r1;
+	for (i = 0; i < n; i++)
+		putchar(p[i]);
+	return n;
+}
+
+// the calls in the order of their #, the fast ones
+// run with interrupts off and get passed R0-R3 straight
+// from _vsvc, the rest get a ureg
+Syscall systab[] = {
+    [SYSNOP] = {sysnop, nil},
+    [SYSUSEC] = {sysusec, nil},
+    [SYSTICKS] = {systicks, nil},
+    [SYSWRITE] = {nil, syswrite},
+};
+
+int nsyscall = nelem(systab);
+
+// handle the system calls that need a ureg,
+// the result goes back in ureg->r0
+void
+syscall(Ureg *ureg)
+{
+	u32 n;
+	int s;
+
+	// the swi before the return address has the call #
+	n = *(u32 *)(ureg->pc - 4) & 0xffffff;
+	if (n >= nsyscall || systab[n].f == nil) {
+		iprint("bad system call %u at %x\n", n, ureg->pc - 4);
+		ureg->r0 = -1;
+		return;
+	}
+
+	// let interrupts in if the caller had them on
+	s = splhi();
+	if (!(ureg->psr & PsrDirq))
+		spllo();
+
+	ureg->r0 = systab[n].f(ureg);
+	splx(s);
+}
@@ -24,6 +24,10 @@ enum {
 
 enum {
 	CLOCKFREQ = 1 * MHZ,
+
+	// delays shorter than this many
+	// microseconds spin instead of sleeping
+	SPINMAX = 10,
 };
 
 Timer phystimer[4] = {
@@ -75,17 +79,41 @@ reset(Timer *t, bool periodic, bool oneshot, bool irq)
 void
 timerinit(void)
 {
-	reset(&phystimer[0], false, false, false);
+	// the free running timer interrupts when it
+	// wraps so fastticks can count the wraps
+	reset(&phystimer[0], false, false, true);
 	reset(&phystimer[1], true, false, true);
 	reset(&phystimer[2], false, true, true);
 }
 
+// start the spare timer interrupting hz times
+// a second, the profiler samples off of it
+void
+proftimer(int hz)
+{
+	Timer *t;
+
+	t = &phystimer[3];
+	reset(t, false, false, false);
+	t->r[LOAD] = CLOCKFREQ / hz;
+	t->r[INTCLR] = 1;
+	t->r[CTRL] |= PERIODIC | INTENABLE;
+}
+
 // delay for n milliseconds
 void
 delay(int n)
 {
-	while (--n >= 0)
-		microdelay(1000);
+	microdelay(n * 1000);
+}
+
+// # of microseconds spent waiting for interrupts
+ulong idleus;
+
+static void
+wakeup(Alarm *a)
+{
+	*(bool *)a->a = true;
 }
 
 // delay for n microseconds
@@ -93,52 +121,294 @@ void
 microdelay(int n)
 {
 	Timer *t;
-	u32 a, b;
+	Alarm a;
+	volatile bool done;
+	u32 b, e;
+	int s;
 
+	// short ones, and ones with interrupts off that
+	// would never see the alarm go off, spin on the timer.
 	// we do not need to worry about underflow here
 	// since the unsignedness of the values ensure
 	// that the wrap around calculation is still right
+	s = splhi();
+	splx(s);
+	if (n < SPINMAX || (s & PsrDirq)) {
+		t = &phystimer[0];
+		b = t->r[VALUE];
+		while (b - t->r[VALUE] < n + 1)
+			;
+		return;
+	}
+
+	// the rest sleep until the alarm goes off, interrupts
+	// are off while checking so one can't come in between
+	// the check and the sleep, the cpu wakes up for them anyway
+	done = false;
+	a.f = wakeup;
+	a.a = (void *)&done;
+	a.index = -1;
+	addalarm(&a, n);
+
+	s = splhi();
+	while (!done) {
+		b = usec();
+		idle();
+		e = usec();
+		idleus += e - b;
+
+		// let the interrupt in
+		splx(s);
+		splhi();
+	}
+	splx(s);
+}
+
+// free running microsecond count,
+// wraps around every 71 minutes or so
+u32
+usec(void)
+{
+	// the timer counts down
+	return ~phystimer[0].r[VALUE];
+}
+
+// # of times usec() has wrapped, counted
+// by the free running timer's interrupt
+static ulong usechi;
+
+// microseconds since boot, 64 bit. interrupts are off while
+// looking so the wrap count can't change under us, but a wrap
+// that happened since they went off is still pending in RIS,
+// count it here and take a value from after it
+uvlong
+fastticks(uvlong *hz)
+{
+	Timer *t;
+	uvlong t64;
+	ulong hi;
+	u32 v;
+	int s;
+
+	if (hz != nil)
+		*hz = CLOCKFREQ;
+
 	t = &phystimer[0];
-	a = t->r[VALUE];
-	while (a - t->r[VALUE] < n + 1)
-		;
+	s = splhi();
+	hi = usechi;
+	v = usec();
+	if (t->r[RIS]) {
+		hi++;
+		v = usec();
+	}
+	t64 = (uvlong)hi << 32 | v;
+	splx(s);
+	return t64;
+}
+
+// nanoseconds since boot
+vlong
+nsec(void)
+{
+	return fastticks(nil) * (1000000000 / CLOCKFREQ);
+}
+
+// # of periodic timer interrupts, one per second
+ulong ticks;
+
+static void
+tickmsg(void *)
+{
+	print("timer #1 periodic interrupt\n");
 }
 
-// handle periodic timer interrupt
+// message printed outside of the interrupt
+static Work tickwork = {tickmsg};
+
+// handle the interrupts of the free running
+// and the periodic timer, they share a line
 void
 timerintr(Ureg *, void *)
 {
 	Timer *t;
 
+	t = &phystimer[0];
+	if (t->r[MIS]) {
+		t->r[INTCLR] = 1;
+		usechi++;
+	}
+
 	t = &phystimer[1];
-	t->r[INTCLR] = 1;
-	iprint("timer #1 periodic interrupt\n");
+	if (t->r[MIS]) {
+		t->r[INTCLR] = 1;
+		ticks++;
+		queuework(&tickwork);
+	}
 }
 
-int scheduled;
+// pending alarms, a min heap on the deadline so the
+// nearest one is always at the top. the one shot timer
+// only gets set for that one, so nothing fires until it is due
+static Alarm *alarms[NALARM];
+static int nalarm;
 
-void
-timeroneintr(Ureg *, void *)
+// deadlines are compared by their difference, so alarms
+// can be up to half the usec() wrap around in the future
+static bool
+before(Alarm *a, Alarm *b)
+{
+	return (s32)(a->when - b->when) < 0;
+}
+
+static void
+swap(int i, int j)
+{
+	Alarm *a;
+
+	a = alarms[i];
+	alarms[i] = alarms[j];
+	alarms[j] = a;
+	alarms[i]->index = i;
+	alarms[j]->index = j;
+}
+
+static void
+siftup(int i)
+{
+	int p;
+
+	for (; i > 0; i = p) {
+		p = (i - 1) / 2;
+		if (!before(alarms[i], alarms[p]))
+			break;
+		swap(i, p);
+	}
+}
+
+static void
+siftdown(int i)
+{
+	int c;
+
+	for (;;) {
+		c = 2 * i + 1;
+		if (c >= nalarm)
+			break;
+		if (c + 1 < nalarm && before(alarms[c + 1], alarms[c]))
+			c++;
+		if (!before(alarms[c], alarms[i]))
+			break;
+		swap(i, c);
+		i = c;
+	}
+}
+
+static bool
+pending(Alarm *a)
+{
+	return a->index >= 0 && a->index < nalarm && alarms[a->index] == a;
+}
+
+// take the alarm at i out of the heap
+static void
+unlink(int i)
+{
+	Alarm *a;
+
+	a = alarms[i];
+	a->index = -1;
+	if (--nalarm == i)
+		return;
+
+	alarms[i] = alarms[nalarm];
+	alarms[i]->index = i;
+	siftup(i);
+	siftdown(alarms[i]->index);
+}
+
+// set the one shot timer for the nearest alarm,
+// or stop it when there are none
+static void
+rearm(void)
 {
 	Timer *t;
+	s32 d;
+
 	t = &phystimer[2];
-	t->r[INTCLR] = 1;
-	iprint("timer #2 one shot interrupt\n");
-	scheduled--;
+	t->r[CTRL] &= ~ENABLE;
+	if (nalarm == 0)
+		return;
+
+	// one that is already late goes off right away
+	d = alarms[0]->when - usec();
+	if (d < 1)
+		d = 1;
+	t->r[LOAD] = d;
+	t->r[CTRL] |= ENABLE;
 }
 
-// schedule event in number of ms from now
+// one shot timer interrupt, run the alarms that are due.
+// they run in the interrupt so they should be quick and
+// leave anything slow to queuework
 void
-schedevent(u32 ms)
+timeroneintr(Ureg *ureg, void *)
 {
 	Timer *t;
+	Alarm *a;
 
-	if (scheduled)
+	// the profiling timer shares the line
+	t = &phystimer[3];
+	if (t->r[MIS]) {
+		t->r[INTCLR] = 1;
+		profsample(ureg);
+	}
+
+	t = &phystimer[2];
+	if (!t->r[MIS])
 		return;
+	t->r[INTCLR] = 1;
+	while (nalarm > 0 && (s32)(alarms[0]->when - usec()) <= 0) {
+		a = alarms[0];
+		unlink(0);
+		a->f(a);
+	}
+	rearm();
+}
 
-	scheduled++;
+// have a->f called us microseconds from now, an alarm
+// that is already pending gets moved to the new time
+void
+addalarm(Alarm *a, u32 us)
+{
+	int s;
 
-	t = &phystimer[2];
-	t->r[LOAD] = ms * 1000;
-	t->r[CTRL] |= ENABLE;
-}
\ No newline at end of file
+	s = splhi();
+	if (pending(a))
+		unlink(a->index);
+	if (nalarm >= NALARM)
+		panic("too many alarms");
+
+	a->when = usec() + us;
+	a->index = nalarm;
+	alarms[nalarm++] = a;
+	siftup(a->index);
+
+	// only the nearest one needs the timer
+	if (alarms[0] == a)
+		rearm();
+	splx(s);
+}
+
+// cancel a pending alarm
+void
+delalarm(Alarm *a)
+{
+	int s;
+
+	s = splhi();
+	if (pending(a)) {
+		unlink(a->index);
+		rearm();
+	}
+	splx(s);
+}
@@ -33,7 +33,21 @@ enum {
 	SOFTINT,
 	SOFTINTCLEAR,
 	PROTECTION,
-	VECTADDR,
+
+	// address of the interrupt being serviced,
+	// and the one given when none is vectored
+	VECTADDR = 0xc,
+	DEFVECTADDR = 0xd,
+
+	// vector slots, the lower the slot
+	// the higher the priority
+	VECTADDR0 = 0x40,
+	VECTCNTL0 = 0x80,
+};
+
+// vector control register bits
+enum {
+	VECTEN = 0x20,
 };
 
 enum {
@@ -42,13 +56,33 @@ enum {
 
 	// # number of interrupt lines
 	NINTR = 32,
+
+	// # of vector slots in the VIC
+	NVECT = 16,
 };
 
-// interrupt vectors
+// interrupt vectors, for the primary
+// and the secondary controller
 static Vctl vctls[NINTR];
+static Vctl sicvctls[NINTR];
+
+// lines that have a vector slot, in slot order,
+// and the mask of them
+static Vctl *slots[NVECT];
+static int nvect;
+static u32 vectored;
 
-// save areas for exceptions, hold R0-R4
-static u32 sfiq[4096];
+// how deep irq() is nested
+static int nesting;
+
+// the one line that goes to the fiq, -1 if none
+static int fiqirq = -1;
+
+// timing of irq() as a whole
+static Intrstat trapstat;
+
+// save areas for exceptions, hold R0-R4 stored
+// upwards from the start without writeback
 static u32 sirq[5];
 static u32 sund[5];
 static u32 sabt[5];
@@ -65,7 +99,7 @@ typedef struct Vpage0 {
 void
 trapinit(void)
 {
-	u32 *sic;
+	u32 *sic, *ip;
 	Vpage0 *vpage0;
 
 	// turn off interrupts
@@ -77,28 +111,76 @@ trapinit(void)
 	memmove(vpage0->vtable, vtable, sizeof(vpage0->vtable));
 	cacheuwbinv();
 
-	// set up the stacks for the interrupt modes
-	setr13(PsrMfiq, sfiq);
+	// set up the save areas for the interrupt modes, they
+	// are written upwards from their base. the fiq has
+	// none, it only uses its banked registers
 	setr13(PsrMirq, sirq);
 	setr13(PsrMabt, sabt);
 	setr13(PsrMund, sund);
 	setr13(PsrMsys, ssys);
 	coherence();
 
-	// enable secondary interrupts
+	// lines without a vector slot read as nil
+	ip = (void *)INTREGS;
+	ip[DEFVECTADDR] = 0;
+	ip[VECTADDR] = 0;
+
+	// secondary interrupts get enabled as they
+	// get handlers, let the ones that can pass
+	// through to the primary controller do so
 	sic = (void *)SICREGS;
-	sic[SICENSET] = 0xffffffff;
+	sic[SICENCLR] = 0xffffffff;
 	sic[SICPICENSET] = 0xffffffff;
 	coherence();
 }
 
+// handle the secondary controller, all of its
+// lines come into the primary one on VIC31IRQ
+static void
+sicintr(Ureg *ureg, void *)
+{
+	Vctl *v;
+	u32 *sic, s;
+	int i;
+
+	// walk the pending bits from the lowest line up,
+	// and look again when we run out in case
+	// more came in while we were at it
+	sic = (void *)SICREGS;
+	while ((s = sic[SICSTAT]) != 0) {
+		do {
+			i = 31 - clz(s & -s);
+			s &= ~(1 << i);
+			v = &sicvctls[i];
+			v->f(ureg, v->a);
+		} while (s);
+	}
+}
+
 // turn interrupts on
 void
 intrson(void)
 {
-	intrenable(TIMER0IRQ, timerintr, nil, "timer0");
-	intrenable(TIMER2IRQ, timeroneintr, nil, "timer2");
-	intrenable(VIC31IRQ, inputinr, nil, "input");
+	u32 *sic;
+
+	// the ps2 devices are the busiest lines and they come in
+	// through the secondary controller, so the whole of it goes to
+	// the fiq where _vfiq drains the bytes, the rest of the input
+	// handling happens on the software interrupt it raises
+	fiqenable(VIC31IRQ);
+	sic = (void *)SICREGS;
+	sic[SICENSET] = 1 << KMI0IRQ | 1 << KMI1IRQ;
+	coherence();
+
+	// the timers go first so the input processing
+	// can't hold them up however long it takes
+	intrenable(TIMER0IRQ, PRIOHI, timerintr, nil, "timer0");
+	intrenable(TIMER2IRQ, PRIOHI, timeroneintr, nil, "timer2");
+	intrenable(CLCDIRQ, PRIOHI + 1, clcdintr, screen, "clcd");
+	intrenable(DMAIRQ, PRIOHI + 2, dmaintr, dma, "dma");
+	intrenable(SWIRQ, PRIOLO, inputinr, nil, "input");
+	intrenable(UART0IRQ, PRIOLO, uartintr, consuart, "uart0");
+	uartirq(consuart);
 
 	spllo();
 }
@@ -114,39 +196,263 @@ intrsoff(void)
 	coherence();
 }
 
-// enable an interrupt line
+// enable an interrupt line, lines with a lower priority
+// number can interrupt its handler and no others can
 void
-intrenable(int irq, void (*f)(Ureg *, void *), void *arg, char *name)
+intrenable(int irq, int prio, void (*f)(Ureg *, void *), void *arg, char *name)
 {
-	u32 *ip;
+	u32 *ip, same;
 	Vctl *v;
+	int i;
 
 	if (irq < 0 || irq >= NINTR)
 		panic("invalid irq %d", irq);
 
 	v = &vctls[irq];
+	v->irq = irq;
+	v->prio = prio;
 	v->f = f;
 	v->a = arg;
 	v->name = name;
 
+	// give the line a vector slot if there is one left,
+	// the VIC then hands us the Vctl when it interrupts.
+	// the VIC takes the lower slots first, so keep them sorted
+	// by priority, lines with the same priority go in the order
+	// they were enabled
 	ip = (void *)INTREGS;
+	if (!(vectored & (1 << irq)) && nvect < NVECT) {
+		for (i = nvect; i > 0 && slots[i - 1]->prio > prio; i--)
+			slots[i] = slots[i - 1];
+		slots[i] = v;
+		vectored |= 1 << irq;
+		nvect++;
+
+		for (; i < nvect; i++) {
+			ip[VECTADDR0 + i] = (uintptr)slots[i];
+			ip[VECTCNTL0 + i] = VECTEN | slots[i]->irq;
+		}
+	}
+
+	// the lines with the same priority have
+	// to keep out of each other's way
+	same = 0;
+	for (i = 0; i < NINTR; i++) {
+		if (vctls[i].f != nil && vctls[i].prio == prio)
+			same |= 1 << i;
+	}
+	for (i = 0; i < NINTR; i++) {
+		if (same & (1 << i))
+			vctls[i].same = same & ~(1 << i);
+	}
+
 	ip[INTENABLE] |= (1 << irq);
 	coherence();
 }
 
+// enable a secondary interrupt line, not
+// while the secondary controller is on the fiq
+void
+sicenable(int irq, void (*f)(Ureg *, void *), void *arg, char *name)
+{
+	u32 *sic;
+	Vctl *v;
+
+	if (irq < 0 || irq >= NINTR)
+		panic("invalid sic irq %d", irq);
+
+	v = &sicvctls[irq];
+	v->irq = irq;
+	v->f = f;
+	v->a = arg;
+	v->name = name;
+
+	// _vfiq only knows the ps2 lines, anything else
+	// there would go unhandled with interrupts stuck on
+	if (fiqirq == VIC31IRQ)
+		panic("sic line %s would go to the fiq", name);
+
+	if (vctls[VIC31IRQ].f == nil)
+		intrenable(VIC31IRQ, PRIOLO, sicintr, nil, "sic");
+
+	sic = (void *)SICREGS;
+	sic[SICENSET] = 1 << irq;
+	coherence();
+}
+
+// route an interrupt line to the fiq, there is only one of
+// those and its handler is _vfiq, which knows only the ps2 lines
+void
+fiqenable(int irq)
+{
+	u32 *ip;
+
+	if (irq < 0 || irq >= NINTR)
+		panic("invalid irq %d", irq);
+	if (fiqirq != -1)
+		panic("fiq already used by irq %d", fiqirq);
+	fiqirq = irq;
+
+	ip = (void *)INTREGS;
+	ip[INTSELECT] |= 1 << irq;
+	ip[INTENABLE] |= 1 << irq;
+	coherence();
+}
+
+// add one interrupt to the stats, lat is how long
+// the dispatcher took to get to the handler and
+// dur how long the handler ran
+static void
+account(Intrstat *st, u32 lat, u32 dur)
+{
+	int i;
+
+	st->count++;
+	st->total += dur;
+	if (st->count == 1 || dur < st->min)
+		st->min = dur;
+	if (dur > st->max)
+		st->max = dur;
+
+	i = 32 - clz(lat);
+	if (i >= NLATHIST)
+		i = NLATHIST - 1;
+	st->lat[i]++;
+}
+
+// raise a software interrupt on a line,
+// the handler has to clear it with softintrclr
+void
+softintr(int irq)
+{
+	u32 *ip;
+
+	ip = (void *)INTREGS;
+	ip[SOFTINT] = 1 << irq;
+	coherence();
+}
+
+void
+softintrclr(int irq)
+{
+	u32 *ip;
+
+	ip = (void *)INTREGS;
+	ip[SOFTINTCLEAR] = 1 << irq;
+	coherence();
+}
+
+// run a handler, with interrupts on so lines with a higher
+// priority can come in. the VIC keeps the slots after this
+// one out until VECTADDR is written, but it would let lines
+// with the same priority in the slots before it through, so
+// those are turned off for the while. nothing gets ahead of
+// PRIOHI lines so those don't bother
+static void
+handle(Vctl *v, Ureg *ureg, u32 t0)
+{
+	u32 *ip, t1, same;
+
+	t1 = usec();
+	if (v->prio == PRIOHI && (vectored & (1 << v->irq))) {
+		v->f(ureg, v->a);
+	} else {
+		ip = (void *)INTREGS;
+		same = ip[INTENABLE] & v->same;
+		ip[INTCLEAR] = same;
+		spllo();
+		v->f(ureg, v->a);
+		splhi();
+		ip[INTENABLE] = same;
+	}
+	account(&v->stat, t1 - t0, usec() - t1);
+}
+
 // handle interrupts
 static void
 irq(Ureg *ureg)
 {
 	Vctl *v;
-	u32 *ip, i;
+	u32 *ip, s, t0;
+	int i;
 
+	// keep going until nothing is pending, so interrupts that
+	// come in while we are handling one don't have to go through
+	// another exception to get serviced
+	t0 = usec();
+	nesting++;
 	ip = (void *)INTREGS;
-	for (i = 0; i < NINTR; i++) {
-		if (ip[INTSTAT] & (1 << i)) {
-			v = &vctls[i];
-			v->f(ureg, v->a);
+	while ((s = ip[INTSTAT]) != 0) {
+		// reading the vector address gives us the highest
+		// priority vectored interrupt pending
+		v = (Vctl *)ip[VECTADDR];
+		if (v != nil) {
+			handle(v, ureg, t0);
+		} else {
+			// lines that did not get a vector slot,
+			// walk the pending bits from the lowest line up
+			s &= ~vectored;
+			if (s == 0) {
+				ip[VECTADDR] = 0;
+				break;
+			}
+
+			do {
+				i = 31 - clz(s & -s);
+				s &= ~(1 << i);
+				handle(&vctls[i], ureg, t0);
+			} while (s);
 		}
+
+		// tell the VIC we are done with the interrupt
+		// so it lets lower priority interrupts through
+		ip[VECTADDR] = 0;
+
+		// the line of the handler we interrupted is still pending,
+		// and reading VECTADDR again would hand it back to us,
+		// so a nested irq only takes the one that got it in
+		if (nesting > 1)
+			break;
+	}
+	nesting--;
+	account(&trapstat, 0, usec() - t0);
+}
+
+static void
+prstat(char *name, Intrstat *st)
+{
+	Intrstat c;
+	int i, s;
+
+	// take a copy so an interrupt
+	// doesn't change it halfway
+	s = splhi();
+	c = *st;
+	splx(s);
+
+	if (c.count == 0)
+		return;
+
+	print("%s\t%u\t%u\t%u\t%u\t%u\t", name, c.count, c.total, c.min, c.total / c.count, c.max);
+	for (i = 0; i < NLATHIST; i++)
+		print(" %u", c.lat[i]);
+	print("\n");
+}
+
+// dump the interrupt timing, in microseconds. handlers time
+// includes the handlers that interrupted them, the latency is
+// from entering the dispatcher to the handler getting called,
+// with the histogram buckets being 0, under 2, 4, 8... us
+void
+intrstats(void)
+{
+	int i;
+
+	print("name\tcount\ttotal\tmin\tavg\tmax\tlatency\n");
+	prstat("irq", &trapstat);
+	for (i = 0; i < NINTR; i++) {
+		if (vctls[i].f != nil)
+			prstat(vctls[i].name, &vctls[i].stat);
 	}
 }
 
@@ -1,6 +1,7 @@
 #include "u.h"
 #include "libc.h"
 #include "dat.h"
+#include "fns.h"
 
 // UART base addresses
 enum {
@@ -14,6 +15,34 @@ enum {
 enum {
 	// DATA register for writing output characters
 	DR = 0x0,
+	FR = 0x6,
+	LCRH = 0xb,
+	IFLS = 0xd,
+	IMSC = 0xe,
+	MIS = 0x10,
+	ICR = 0x11,
+};
+
+// flag register bits
+enum {
+	TXFF = 1 << 5,
+};
+
+// line control bits
+enum {
+	FEN = 1 << 4,
+};
+
+// fifo level select, the transmit interrupt goes
+// off once the fifo drains to the level picked
+enum {
+	TXIFLSMASK = 0x7,
+	TXIFLS1_8 = 0x0,
+};
+
+// interrupt bits
+enum {
+	TXI = 1 << 5,
 };
 
 // physical UART device descriptions
@@ -36,13 +65,112 @@ Uart physuart[] = {
 void
 uartinit(void)
 {
+	Uart *u;
+
 	// use UART0 for the console output
-	consuart = &physuart[0];
+	u = &physuart[0];
+	consuart = u;
+
+	// turn on the fifos, and have the transmit interrupt
+	// wait until the fifo is nearly empty so each one
+	// refills most of it
+	u->r[LCRH] |= FEN;
+	u->r[IFLS] = (u->r[IFLS] & ~TXIFLSMASK) | TXIFLS1_8;
+}
+
+// move what fits from the ring into the fifo, and only have
+// the fifo interrupt while there is something left to move
+static void
+kick(Uart *u)
+{
+	while (u->rp != u->wp && !(u->r[FR] & TXFF)) {
+		u->r[DR] = u->buf[u->rp & (NUARTBUF - 1)];
+		u->rp++;
+	}
+
+	if (u->rp != u->wp)
+		u->r[IMSC] |= TXI;
+	else
+		u->r[IMSC] &= ~TXI;
+}
+
+// write out the ring by polling the fifo
+static void
+flush(Uart *u)
+{
+	while (u->rp != u->wp) {
+		while (u->r[FR] & TXFF)
+			;
+		u->r[DR] = u->buf[u->rp & (NUARTBUF - 1)];
+		u->rp++;
+	}
+	u->r[IMSC] &= ~TXI;
 }
 
-// output a character to UART
+// write out c by polling the fifo, after what is in
+// the ring so the output stays in order. used when
+// the interrupt can't come in
+static void
+polledputc(Uart *u, int c)
+{
+	flush(u);
+	while (u->r[FR] & TXFF)
+		;
+	u->r[DR] = c;
+}
+
+// output a character to UART, it goes into the ring
+// and the interrupt feeds it to the fifo from there.
+// before interrupts are set up, with them off or
+// when the ring is full it waits on the fifo instead
 void
 uartputc(Uart *u, int c)
 {
-	u->r[DR] = c;
+	int s;
+
+	s = splhi();
+	if (!u->intr || (s & PsrDirq) || u->wp - u->rp >= NUARTBUF) {
+		polledputc(u, c);
+		splx(s);
+		return;
+	}
+
+	u->buf[u->wp & (NUARTBUF - 1)] = c;
+	u->wp++;
+	kick(u);
+	splx(s);
+}
+
+// switch to interrupt driven output
+void
+uartirq(Uart *u)
+{
+	u->intr = true;
+}
+
+// go back to polling, for panic
+void
+uartpolled(Uart *u)
+{
+	int s;
+
+	s = splhi();
+	u->intr = false;
+	flush(u);
+	splx(s);
+}
+
+// fifo interrupt, fill it up again. a handler that
+// interrupts this one could be printing, so keep them out
+void
+uartintr(Ureg *, void *a)
+{
+	Uart *u;
+	int s;
+
+	u = a;
+	s = splhi();
+	u->r[ICR] = TXI;
+	kick(u);
+	splx(s);
 }
@@ -0,0 +1,58 @@
+#include "u.h"
+#include "libc.h"
+#include "dat.h"
+#include "fns.h"
+
+// work queued by interrupt handlers, handlers only put
+// into the ring at wp and the main loop only takes out
+// of it at rp, so taking out never needs interrupts off
+static struct {
+	Work *w[NWORK];
+	volatile ulong rp, wp;
+	ulong overrun;
+} work;
+
+// queue w to run outside of the interrupt, returns false if the
+// queue is full. w is only queued once until it has run, so calling
+// this again before then is free. not for use from the fiq, which
+// gets in with interrupts off
+bool
+queuework(Work *w)
+{
+	int s;
+
+	// nested interrupts can both be putting work in,
+	// keep them off for the few instructions it takes
+	s = splhi();
+	if (w->queued) {
+		splx(s);
+		return true;
+	}
+	if (work.wp - work.rp >= NWORK) {
+		work.overrun++;
+		splx(s);
+		return false;
+	}
+	w->queued = true;
+	work.w[work.wp & (NWORK - 1)] = w;
+	work.wp++;
+	splx(s);
+	return true;
+}
+
+// run the queued work, with interrupts on
+void
+runwork(void)
+{
+	Work *w;
+
+	while (work.rp != work.wp) {
+		w = work.w[work.rp & (NWORK - 1)];
+		work.rp++;
+
+		// clear it first so the work can be
+		// queued again while it is running
+		w->queued = false;
+		w->f(w->a);
+	}
+}
@@ -20,12 +20,14 @@ enum {
 	LPBASE = 0x5,
 	CTRL = 0x6,
 	IMSC = 0x7,
+	RIS = 0x8,
+	MIS = 0x9,
 	ICR = 0xa,
 	SYS = 0x14,
 	PAL = 0x80,
 };
 
-// system register bits 
+// system register bits
 enum {
 	PWR3V5 = 0x10,
 	LCDIOON = 0x4,
@@ -40,6 +42,14 @@ enum {
 	CR_PWR = 0x800,
 };
 
+// interrupt bits
+enum {
+	FUF = 0x2,
+	LNBU = 0x4,
+	VCOMP = 0x8,
+	MBERROR = 0x10,
+};
+
 // color depth
 enum {
 	BPP1 = 0,
@@ -52,15 +62,63 @@ enum {
 	BPP12,
 };
 
+enum {
+	// how many 100 microsecond intervals
+	// to wait for a page flip (20 ms)
+	FLIPWAIT = 200,
+};
+
 Clcd physclcd[] = {
     {
         .r = (void *)CLCD,
         .w = 640,
         .h = 480,
-        .fb = (void *)0x150000,
+        .depth = 16,
+        .page = {
+            (void *)0x150000,
+            (void *)0x27c000,
+        },
     },
 };
 
+// returns the palette entry for a 3-3-2 color index, the
+// entries are 5 bits each of red, green and blue. red goes in
+// the top field, the same one 16 bit pixels keep red in, so
+// the controller shows both depths with the same colors
+static u32
+palentry(int i)
+{
+	u32 r, g, b;
+
+	r = (i >> 5) & 0x7;
+	g = (i >> 2) & 0x7;
+	b = i & 0x3;
+	r = (r << 2) | (r >> 1);
+	g = (g << 2) | (g >> 1);
+	b = (b << 3) | (b << 1) | (b >> 1);
+	return b | (g << 5) | (r << 10);
+}
+
+// returns the color depth setting for the
+// control register, 8 bit color needs the
+// palette to be loaded
+static int
+format(Clcd *c)
+{
+	int i;
+
+	switch (c->depth) {
+	case 8:
+		// each palette register holds two entries
+		for (i = 0; i < 256; i += 2)
+			c->r[PAL + i / 2] = palentry(i) | (palentry(i + 1) << 16);
+		return BPP8;
+	case 16:
+		return BPP16_565;
+	}
+	return BPP32;
+}
+
 // resets the CLCD controller
 static void
 reset(Clcd *c)
@@ -71,12 +129,18 @@ reset(Clcd *c)
 	// setup width/height
 	c->r[TIM0] = c->w / 4 - 4;
 	c->r[TIM1] = c->h - 1;
+	c->stride = c->w * (c->depth / 8);
 
-	// frame buffer location
-	c->r[UPBASE] = (uintptr)c->fb;
+	// draw to the whole screen
+	c->clipr = (Rect){0, 0, c->w, c->h};
 
-	// 32 bit color (rgba)
-	c->r[CTRL] = (BPP32 << 1);
+	// show the first page and draw to the second
+	c->back = 1;
+	c->fb = c->page[c->back];
+	c->r[UPBASE] = (uintptr)c->page[0];
+
+	// pixel format
+	c->r[CTRL] = format(c) << 1;
 }
 
 // disable the screen, it leaves whatever was on
@@ -95,6 +159,33 @@ clcdenable(Clcd *c)
 	c->r[CTRL] |= (CR_PWR | CR_EN);
 }
 
+// show the page we have been drawing to and make the
+// page that was on the screen the new drawing target
+void
+clcdflip(Clcd *c)
+{
+	int i;
+
+	c->r[ICR] = LNBU;
+	c->r[UPBASE] = (uintptr)c->fb;
+	c->back ^= 1;
+	c->fb = c->page[c->back];
+
+	// the controller only latches the new base address
+	// at the start of the next frame, wait for that to happen
+	// so we don't draw to the page that is still being shown.
+	// give up after a frame's worth of time, and if the
+	// device never reported the update don't wait for it again
+	if (c->nolnbu)
+		return;
+	for (i = 0; i < FLIPWAIT; i++) {
+		if (c->r[RIS] & LNBU)
+			return;
+		microdelay(100);
+	}
+	c->nolnbu = true;
+}
+
 // initializes the CLCD display controller
 void
 clcdinit(void)
@@ -102,5 +193,7 @@ clcdinit(void)
 	reset(&physclcd[0]);
 	screen = &physclcd[0];
 	fillrect(0, 0, screen->w, screen->h, 0xff555555);
-	microdelay(5);
+	clcdflip(screen);
+	fillrect(0, 0, screen->w, screen->h, 0xff555555);
+	clcdenable(screen);
 }
@@ -5,16 +5,53 @@ typedef struct Input Input;
 typedef struct Cursor Cursor;
 typedef struct Texture Texture;
 typedef struct Rect Rect;
+typedef struct Damage Damage;
 
 struct Uart {
 	volatile u32 *r;
 };
 
+enum {
+	// max # of dirty rectangles tracked per page
+	NDAMAGE = 16,
+
+	// max width and height of the cursor
+	CURSORMAX = 32,
+};
+
+struct Rect {
+	int x, y, w, h;
+};
+
+struct Damage {
+	Rect r[NDAMAGE];
+	int n;
+};
+
 struct Clcd {
 	volatile u32 *r;
 
 	int w, h;
-	u32 *fb;
+
+	// bits per pixel (8, 16 or 32) and
+	// the number of bytes in a row
+	int depth;
+	int stride;
+
+	// fb is the page we are drawing to,
+	// the other page is being shown
+	uchar *fb;
+	uchar *page[2];
+	int back;
+
+	// drawing is clipped to clipr, dirty
+	// holds what each page needs redrawn
+	Rect clipr;
+	Damage dirty[2];
+
+	// set once a flip went unreported, some
+	// controllers (QEMU's) never report them
+	bool nolnbu;
 };
 
 struct Timer {
@@ -30,15 +67,31 @@ struct Cursor {
 	int x, y;
 	int dx, dy;
 	int w, h;
+	u32 color;
+};
+
+// how texture pixels are combined with the screen
+enum {
+	// copy the pixels as is
+	BLENDCOPY,
+
+	// skip pixels that match the color key
+	BLENDKEY,
+
+	// composite the pixels over the screen using their alpha
+	BLENDOVER,
 };
 
 struct Texture {
 	int w, h;
-	u32 *p;
-};
 
-struct Rect {
-	int x, y, w, h;
+	// pixels are depth bits each, the color
+	// key is in the same format as the pixels
+	int depth;
+	void *p;
+
+	int blend;
+	u32 key;
 };
 
 #define MHZ 1000000
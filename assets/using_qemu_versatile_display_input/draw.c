@@ -3,28 +3,426 @@
 #include "dat.h"
 #include "fns.h"
 
+// clip rectangle r against rectangle b, returns false
+// if nothing of r is left inside of b
+bool
+rectclip(Rect *r, Rect b)
+{
+	int x0, y0, x1, y1;
+
+	x0 = max(r->x, b.x);
+	y0 = max(r->y, b.y);
+	x1 = min(r->x + r->w, b.x + b.w);
+	y1 = min(r->y + r->h, b.y + b.h);
+	if (x0 >= x1 || y0 >= y1)
+		return false;
+
+	*r = (Rect){x0, y0, x1 - x0, y1 - y0};
+	return true;
+}
+
+// returns true if the rectangles overlap
+static bool
+rectXrect(Rect a, Rect b)
+{
+	return a.x < b.x + b.w && b.x < a.x + a.w &&
+	       a.y < b.y + b.h && b.y < a.y + a.h;
+}
+
+// returns the smallest rectangle covering both rectangles
+static Rect
+rectunion(Rect a, Rect b)
+{
+	int x0, y0, x1, y1;
+
+	x0 = min(a.x, b.x);
+	y0 = min(a.y, b.y);
+	x1 = max(a.x + a.w, b.x + b.w);
+	y1 = max(a.y + a.h, b.y + b.h);
+	return (Rect){x0, y0, x1 - x0, y1 - y0};
+}
+
+// add a rectangle to a damage list, anything it
+// overlaps gets merged with it so the list never
+// has two rectangles covering the same pixels
+static void
+adddamage(Damage *d, Rect r)
+{
+	int i;
+
+again:
+	for (i = 0; i < d->n; i++) {
+		if (rectXrect(d->r[i], r)) {
+			r = rectunion(d->r[i], r);
+			d->r[i] = d->r[--d->n];
+			goto again;
+		}
+	}
+
+	// if we run out of space, fold everything
+	// into one rectangle covering all of it
+	if (d->n == nelem(d->r)) {
+		for (i = 0; i < d->n; i++)
+			r = rectunion(r, d->r[i]);
+		d->n = 0;
+	}
+	d->r[d->n++] = r;
+}
+
+// mark a region of the screen as needing a redraw,
+// each page keeps its own list since the page we draw
+// to next has missed the updates of the page on screen
+void
+damage(Rect r)
+{
+	int i;
+
+	if (!rectclip(&r, (Rect){0, 0, screen->w, screen->h}))
+		return;
+
+	for (i = 0; i < nelem(screen->dirty); i++)
+		adddamage(&screen->dirty[i], r);
+}
+
+// convert a 32 bit rgb color to a pixel of the given depth,
+// 16 bit is rgb565 and 8 bit indexes a 3-3-2 palette
+static u32
+rgbpixel(u32 c, int depth)
+{
+	switch (depth) {
+	case 8:
+		return ((c >> 16) & 0xe0) | ((c >> 11) & 0x1c) | ((c >> 6) & 0x3);
+	case 16:
+		return ((c >> 8) & 0xf800) | ((c >> 5) & 0x7e0) | ((c >> 3) & 0x1f);
+	}
+	return c;
+}
+
+// repeat a pixel of the given depth across a word
+static u32
+replicate(u32 p, int depth)
+{
+	switch (depth) {
+	case 8:
+		return p * 0x01010101;
+	case 16:
+		return p | (p << 16);
+	}
+	return p;
+}
+
+// returns the address of a pixel on a page
+static uchar *
+pixaddr(uchar *page, int x, int y)
+{
+	return &page[y * screen->stride + x * (screen->depth / 8)];
+}
+
+// fill n bytes at p with the pixels replicated in v, the
+// unaligned ends are done a byte at a time and the rest
+// a word at a time
+static void
+fillspan(uchar *p, int n, u32 v)
+{
+	for (; n > 0 && ((uintptr)p & 3); n--, p++)
+		*p = v >> (8 * ((uintptr)p & 3));
+
+	memset32((u32 *)p, v, n / 4);
+	p += n & ~3;
+	n &= 3;
+
+	for (; n > 0; n--, p++)
+		*p = v >> (8 * ((uintptr)p & 3));
+}
+
+// copy n bytes from s to d, using word copies when both
+// line up the same way and halfword copies when they
+// are at least halfword aligned with each other. it goes
+// front to back, so d may overlap s if it is below it
+static void
+copyspan(uchar *d, uchar *s, int n)
+{
+	u16 *dh, *sh;
+
+	if (((uintptr)d & 3) == ((uintptr)s & 3)) {
+		for (; n > 0 && ((uintptr)d & 3); n--)
+			*d++ = *s++;
+
+		memcpy32((u32 *)d, (u32 *)s, n / 4);
+		d += n & ~3;
+		s += n & ~3;
+		n &= 3;
+	} else if (((uintptr)d & 1) == ((uintptr)s & 1)) {
+		if ((uintptr)d & 1) {
+			*d++ = *s++;
+			n--;
+		}
+
+		dh = (u16 *)d;
+		sh = (u16 *)s;
+		for (; n >= 2; n -= 2)
+			*dh++ = *sh++;
+		d = (uchar *)dh;
+		s = (uchar *)sh;
+	}
+
+	for (; n > 0; n--)
+		*d++ = *s++;
+}
+
 // sets a pixel on the screen
 void
 setpixel(int x, int y, u32 c)
 {
-	if (!(0 <= x && x < screen->w))
+	Rect *r;
+	uchar *p;
+
+	r = &screen->clipr;
+	if (!(r->x <= x && x < r->x + r->w))
 		return;
-	if (!(0 <= y && y < screen->h))
+	if (!(r->y <= y && y < r->y + r->h))
 		return;
 
-	screen->fb[y * screen->w + x] = c;
+	p = pixaddr(screen->fb, x, y);
+	switch (screen->depth) {
+	case 8:
+		*p = rgbpixel(c, 8);
+		break;
+	case 16:
+		*(u16 *)p = rgbpixel(c, 16);
+		break;
+	default:
+		*(u32 *)p = c;
+		break;
+	}
 }
 
 // draw a filled rectangle on the screen
 void
 fillrect(int x, int y, int w, int h, u32 c)
 {
-	int px, py;
+	Rect r;
+	uchar *p;
+	u32 v;
+	int n;
+
+	// clip once up front, so the inner loop
+	// can write whole rows without any checks
+	r = (Rect){x, y, w, h};
+	if (!rectclip(&r, screen->clipr))
+		return;
+
+	v = replicate(rgbpixel(c, screen->depth), screen->depth);
+	n = r.w * (screen->depth / 8);
+
+	// a full width rectangle is contiguous in memory
+	// so it can be filled in one go
+	p = pixaddr(screen->fb, r.x, r.y);
+	if (r.w == screen->w) {
+		fillspan(p, n * r.h, v);
+		return;
+	}
+
+	for (; r.h > 0; r.h--) {
+		fillspan(p, n, v);
+		p += screen->stride;
+	}
+}
+
+// software cursor, it is drawn on top of the page being
+// shown with the pixels under it saved, so it can move
+// around without the scene having to be redrawn
+static struct {
+	// where the cursor is on each page,
+	// an empty rectangle if it is not on it
+	Rect r[2];
+
+	// what was under the cursor on each page
+	uchar save[2][CURSORMAX * CURSORMAX * 4];
+} ovl;
+
+// put the cursor on a page, saving the pixels under it
+void
+cursorput(int page, Cursor *c)
+{
+	Rect r;
+	uchar *p, *s;
+	u32 v;
+	int n, y;
+
+	// anything bigger than what we can save is cut off
+	ovl.r[page] = (Rect){0, 0, 0, 0};
+	r = (Rect){c->x, c->y, min(c->w, CURSORMAX), min(c->h, CURSORMAX)};
+	if (!rectclip(&r, (Rect){0, 0, screen->w, screen->h}))
+		return;
+
+	ovl.r[page] = r;
+	v = replicate(rgbpixel(c->color, screen->depth), screen->depth);
+	n = r.w * (screen->depth / 8);
+	p = pixaddr(screen->page[page], r.x, r.y);
+	s = ovl.save[page];
+	for (y = 0; y < r.h; y++) {
+		copyspan(s, p, n);
+		fillspan(p, n, v);
+		p += screen->stride;
+		s += n;
+	}
+}
+
+// take the cursor off a page, putting back what was under it
+void
+cursorremove(int page)
+{
+	Rect r;
+	uchar *p, *s;
+	int n, y;
 
-	for (py = y; py < y + h; py++) {
-		for (px = x; px < x + w; px++) {
-			setpixel(px, py, c);
+	r = ovl.r[page];
+	n = r.w * (screen->depth / 8);
+	p = pixaddr(screen->page[page], r.x, r.y);
+	s = ovl.save[page];
+	for (y = 0; y < r.h; y++) {
+		copyspan(p, s, n);
+		p += screen->stride;
+		s += n;
+	}
+	ovl.r[page] = (Rect){0, 0, 0, 0};
+}
+
+// move the cursor on the page being shown, only
+// the pixels under the cursor get touched
+void
+cursormove(Cursor *c)
+{
+	int page;
+
+	page = screen->back ^ 1;
+	cursorremove(page);
+	cursorput(page, c);
+}
+
+// convert a texture of 32 bit pixels to the depth of the screen.
+// it is done in place since the converted pixels never take up more
+// room than the original ones. the lower depths have no alpha, so
+// alpha blended textures get their mostly transparent pixels turned
+// into the color key and the rest are drawn opaque
+void
+texconvert(Texture *t)
+{
+	u32 *s, c;
+	u16 *h;
+	uchar *b;
+	bool keyed;
+	int i, n;
+
+	if (t->depth == screen->depth)
+		return;
+
+	s = t->p;
+	h = t->p;
+	b = t->p;
+	n = t->w * t->h;
+	keyed = (t->blend == BLENDKEY);
+	for (i = 0; i < n; i++) {
+		c = s[i];
+		if (t->blend == BLENDOVER && (c >> 24) < 0x80) {
+			c = t->key;
+			keyed = true;
 		}
+
+		c = rgbpixel(c, screen->depth);
+		if (screen->depth == 16)
+			h[i] = c;
+		else
+			b[i] = c;
+	}
+
+	t->key = rgbpixel(t->key, screen->depth);
+	t->blend = keyed ? BLENDKEY : BLENDCOPY;
+	t->depth = screen->depth;
+}
+
+// copy a row of texture pixels as is
+static void
+copyrow(uchar *d, uchar *s, int n, Texture *t)
+{
+	copyspan(d, s, n * (t->depth / 8));
+}
+
+// copy a row of texture pixels, skipping
+// the ones that match the color key
+static void
+keyrow32(uchar *d, uchar *s, int n, Texture *t)
+{
+	u32 *dp, *sp, k;
+	int i;
+
+	dp = (u32 *)d;
+	sp = (u32 *)s;
+	k = t->key;
+	for (i = 0; i < n; i++) {
+		if (sp[i] != k)
+			dp[i] = sp[i];
+	}
+}
+
+static void
+keyrow16(uchar *d, uchar *s, int n, Texture *t)
+{
+	u16 *dp, *sp, k;
+	int i;
+
+	dp = (u16 *)d;
+	sp = (u16 *)s;
+	k = t->key;
+	for (i = 0; i < n; i++) {
+		if (sp[i] != k)
+			dp[i] = sp[i];
+	}
+}
+
+static void
+keyrow8(uchar *d, uchar *s, int n, Texture *t)
+{
+	uchar k;
+	int i;
+
+	k = t->key;
+	for (i = 0; i < n; i++) {
+		if (s[i] != k)
+			d[i] = s[i];
+	}
+}
+
+// composite a row of 32 bit texture pixels over the screen
+// using the alpha in the top byte of the texture pixels
+static void
+overrow(uchar *d, uchar *s, int n, Texture *)
+{
+	u32 *dp, *sp, a, b, p, q, rb, g;
+	int i;
+
+	dp = (u32 *)d;
+	sp = (u32 *)s;
+	for (i = 0; i < n; i++) {
+		p = sp[i];
+		a = p >> 24;
+		if (a == 0)
+			continue;
+		if (a == 0xff) {
+			dp[i] = p;
+			continue;
+		}
+
+		// scale alpha from [0, 255] to [0, 256] so we can
+		// divide with a shift, then blend red and blue
+		// together in one multiply and green in another
+		a += a >> 7;
+		b = 256 - a;
+		q = dp[i];
+		rb = ((p & 0xff00ff) * a + (q & 0xff00ff) * b) >> 8;
+		g = ((p & 0xff00) * a + (q & 0xff00) * b) >> 8;
+		dp[i] = 0xff000000 | (rb & 0xff00ff) | (g & 0xff00);
 	}
 }
 
@@ -32,8 +430,15 @@ fillrect(int x, int y, int w, int h, u32 c)
 void
 filltexture(Texture *t, Rect *d, Rect *s)
 {
-	Rect dp, sp;
-	int x, y, w, h, tx, ty;
+	void (*row)(uchar *, uchar *, int, Texture *);
+	Rect dp, sp, r;
+	uchar *dst, *src;
+	int n;
+
+	// the texture has to be converted to
+	// the screen depth before it can be drawn
+	if (t->depth != screen->depth)
+		return;
 
 	dp = (Rect){0, 0, screen->w, screen->h};
 	sp = (Rect){0, 0, t->w, t->h};
@@ -42,16 +447,45 @@ filltexture(Texture *t, Rect *d, Rect *s)
 	if (s)
 		sp = *s;
 
-	w = min(dp.w, sp.w);
-	h = min(dp.h, sp.h);
-	for (ty = sp.y, y = dp.y; y < dp.y + h; y++, ty++) {
-		for (tx = sp.x, x = dp.x; x < dp.x + w; x++, tx++) {
-			if (!(0 <= tx && tx < t->w))
-				continue;
-			if (!(0 <= ty && ty < t->h))
-				continue;
+	// figure out what part of the destination we can draw to
+	// up front, it has to be on the screen and it has to map to
+	// pixels inside of the texture. after that every row is a
+	// straight copy
+	r = (Rect){dp.x, dp.y, min(dp.w, sp.w), min(dp.h, sp.h)};
+	if (!rectclip(&r, screen->clipr))
+		return;
+	if (!rectclip(&r, (Rect){dp.x - sp.x, dp.y - sp.y, t->w, t->h}))
+		return;
 
-			setpixel(x, y, t->p[ty * t->w + tx]);
+	// pick the blending once, rather than for every pixel
+	switch (t->blend) {
+	case BLENDKEY:
+		switch (t->depth) {
+		case 8:
+			row = keyrow8;
+			break;
+		case 16:
+			row = keyrow16;
+			break;
+		default:
+			row = keyrow32;
+			break;
 		}
+		break;
+	case BLENDOVER:
+		row = overrow;
+		break;
+	default:
+		row = copyrow;
+		break;
+	}
+
+	n = t->depth / 8;
+	dst = pixaddr(screen->fb, r.x, r.y);
+	src = (uchar *)t->p + ((r.y - dp.y + sp.y) * t->w + (r.x - dp.x + sp.x)) * n;
+	for (; r.h > 0; r.h--) {
+		row(dst, src, r.w, t);
+		dst += screen->stride;
+		src += t->w * n;
 	}
 }
@@ -4,6 +4,7 @@ void uartinit(void);
 void clcdinit(void);
 void clcddisable(Clcd *);
 void clcdenable(Clcd *);
+void clcdflip(Clcd *);
 
 void inputinit(void);
 void pollinput(u32 *, u32 *);
@@ -11,10 +12,19 @@ void updatecursor(Cursor *, u32);
 
 void setpixel(int, int, u32);
 void fillrect(int, int, int, int, u32);
+bool rectclip(Rect *, Rect);
+void damage(Rect);
+void cursorput(int, Cursor *);
+void cursorremove(int);
+void cursormove(Cursor *);
+void memset32(u32 *, u32, ulong);
+void memcpy32(u32 *, u32 *, ulong);
 void filltexture(Texture *, Rect *, Rect *);
+void texconvert(Texture *);
 
 void timerinit(void);
 void delay(int);
 void microdelay(int);
+u32 usec(void);
 
 #define round(x, r) (((x) + ((r)-1)) & ~(r))
\ No newline at end of file
@@ -113,4 +113,9 @@ updatecursor(Cursor *c, u32 ms)
 		c->y = 0;
 	if (c->y + c->h >= screen->h)
 		c->y = screen->h - c->h;
+
+	// put the cursor at the new spot
+	// on the screen right away
+	if (c->dx || c->dy)
+		cursormove(c);
 }
@@ -7,6 +7,7 @@
 Cursor cursor = {
     .w = 15,
     .h = 15,
+    .color = 0xff00ff00,
 };
 
 // our screen
@@ -27,6 +28,31 @@ artinit(void)
 	t->p = art;
 	t->w = 190;
 	t->h = 222;
+	t->depth = 32;
+	t->blend = BLENDOVER;
+
+	// the art is stored as 32 bit pixels,
+	// convert it to what the screen uses
+	texconvert(t);
+}
+
+// time a w by h fill done a pixel at a time through setpixel,
+// the way fillrect used to, against fillrect itself
+static void
+fillbench(int w, int h)
+{
+	u32 t0, t1, t2;
+	int x, y;
+
+	t0 = usec();
+	for (y = 0; y < h; y++)
+		for (x = 0; x < w; x++)
+			setpixel(x, y, 0xff555555);
+	t1 = usec();
+	fillrect(0, 0, w, h, 0xff555555);
+	t2 = usec();
+
+	print("fill %dx%d: setpixel %u us, fillrect %u us\n", w, h, t1 - t0, t2 - t1);
 }
 
 // get keyboard and mouse events
@@ -47,34 +73,48 @@ event(void)
 	}
 }
 
+// draw the scene, only the parts inside
+// of screen->clipr get touched
 static void
-draw(void)
+redraw(void)
 {
 	Rect r;
 
-	// disable the screen so we can draw to it
-	// if we enable the screen while drawing, it can cause
-	// the update to show partial updates, where as we want
-	// something like double buffering, this achieves something
-	// like double-buffering
-	clcddisable(screen);
-
 	// clear to a gray background
 	fillrect(0, 0, screen->w, screen->h, 0xff555555);
 
 	// draw a image at the center of the screen
 	r = (Rect){(screen->w - pic.w) / 2, (screen->h - pic.h) / 2, pic.w, pic.h};
 	filltexture(&pic, &r, nil);
+}
 
-	// draw our cursor
-	fillrect(cursor.x, cursor.y, cursor.w, cursor.h, 0xff00ff00);
-
-	// draw the device, we need to delay a little so QEMU can have a chance to refresh
-	// if we do not have a delay, QEMU can get into a execution path where it only
-	// sees the disable and not the enable when it decides to refresh, thus giving
-	// us a black screen.
-	clcdenable(screen);
-	delay(5);
+static void
+draw(void)
+{
+	Damage *d;
+	int i;
+
+	// nothing changed on the page we are drawing to
+	d = &screen->dirty[screen->back];
+	if (d->n == 0)
+		return;
+
+	// only redraw the parts of the screen that changed
+	for (i = 0; i < d->n; i++) {
+		screen->clipr = d->r[i];
+		redraw();
+	}
+	d->n = 0;
+	screen->clipr = (Rect){0, 0, screen->w, screen->h};
+
+	// the cursor is not part of the scene, updatecursor moves it
+	// around on the page being shown. put it on the page we are about
+	// to show and take it off the page we will draw to next.
+	// we always draw to the page that is not on the screen so partial
+	// updates are never seen
+	cursorput(screen->back, &cursor);
+	clcdflip(screen);
+	cursorremove(screen->back);
 }
 
 void
@@ -89,12 +129,20 @@ main(void)
 	// setup the display so we can draw to the screen
 	clcdinit();
 
+	// see how long filling takes, the page
+	// drawn to gets cleared again by the first frame
+	fillbench(screen->w, screen->h);
+	fillbench(32, 32);
+
 	// setup keyboard and mouse
 	inputinit();
 
 	// setup texture for drawing
 	artinit();
 
+	// draw everything the first time around
+	damage((Rect){0, 0, screen->w, screen->h});
+
 	// game style loop
 	for (;;) {
 		event();
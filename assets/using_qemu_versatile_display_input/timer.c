@@ -52,6 +52,15 @@ timerinit(void)
 	reset(&phystimer[0]);
 }
 
+// microseconds since the timer was started, it wraps
+// around every 71 minutes or so
+u32
+usec(void)
+{
+	// the timer counts down
+	return ~phystimer[0].r[VALUE];
+}
+
 // delay for n milliseconds
 void
 delay(int n)